@@ -9,32 +9,75 @@ CONFIG += c++14
 
 SOURCES += \
     animation.cpp \
+    asset_loader.cpp \
+    bloom.cpp \
     framebuffer.cpp \
+    frustum.cpp \
+    gl_state.cpp \
+    image.cpp \
     main.cpp \
     mainwindow.cpp \
     mainview.cpp \
+    mapped_file.cpp \
+    memory_usage.cpp \
     mesh.cpp \
+    mesh_data.cpp \
+    mesh_optimizer.cpp \
+    mesh_simplifier.cpp \
     scene.cpp \
     shader.cpp \
+    shadow_map.cpp \
     texture.cpp \
+    texture_array.cpp \
+    texture_cache.cpp \
+    texture_data.cpp \
+    texture_streamer.cpp \
+    texture_uploader.cpp \
     transform.cpp \
     user_input.cpp \
-    model.cpp
+    vertex_format.cpp \
+    model.cpp \
+    obj_parser.cpp \
+    render_queue.cpp \
+    uniform_ring.cpp \
+    uniform_table.cpp
 
 HEADERS += \
     animation.h \
+    asset_loader.h \
+    bloom.h \
     framebuffer.h \
+    frustum.h \
+    gl_state.h \
+    image.h \
     light.h \
     mainwindow.h \
     mainview.h \
+    mapped_file.h \
+    memory_usage.h \
     material.h \
     mesh.h \
+    mesh_data.h \
+    mesh_optimizer.h \
+    mesh_simplifier.h \
     model.h \
+    obj_parser.h \
+    render_queue.h \
     scene.h \
     shader.h \
+    shadow_map.h \
     texture.h \
+    texture_array.h \
+    texture_cache.h \
+    texture_data.h \
+    texture_streamer.h \
+    texture_uploader.h \
     transform.h \
-    vertex.h
+    uniform_blocks.h \
+    uniform_ring.h \
+    uniform_table.h \
+    vertex.h \
+    vertex_format.h
 
 FORMS += \
     mainwindow.ui
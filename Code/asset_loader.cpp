@@ -0,0 +1,72 @@
+#include <QElapsedTimer>
+#include <QRunnable>
+#include <QThread>
+
+#include <algorithm>
+
+#include "asset_loader.h"
+
+class AssetLoader::Task : public QRunnable {
+public:
+  Task(AssetLoader& loader, std::function<std::function<void()>()> work)
+      : loader(loader), work(std::move(work)) {}
+
+  void run() override {
+    auto finish = work();
+    std::lock_guard<std::mutex> lock(loader.mutex);
+    loader.ready.push_back(std::move(finish));
+  }
+
+private:
+  AssetLoader& loader;
+  std::function<std::function<void()>()> work;
+};
+
+AssetLoader::AssetLoader() {
+  pool.setMaxThreadCount(std::max(QThread::idealThreadCount() - 1, 1));
+}
+
+AssetLoader::~AssetLoader() {
+  // Drop the assets nobody started loading yet
+  pool.clear();
+  pool.waitForDone();
+}
+
+void AssetLoader::submit(std::function<std::function<void()>()> work) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    ++pending_count;
+  }
+  pool.start(new Task(*this, std::move(work)));
+}
+
+int AssetLoader::finish_ready(qint64 budget_ns) {
+  QElapsedTimer timer;
+  timer.start();
+
+  int finished = 0;
+  do {
+    std::function<void()> finish;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (ready.empty()) {
+        break;
+      }
+      finish = std::move(ready.front());
+      ready.pop_front();
+    }
+
+    finish();
+    ++finished;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    --pending_count;
+  } while (timer.nsecsElapsed() < budget_ns);
+
+  return finished;
+}
+
+int AssetLoader::pending() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return pending_count;
+}
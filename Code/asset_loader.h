@@ -0,0 +1,55 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <QThreadPool>
+#include <QtGlobal>
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+// Runs the CPU-side part of loading assets (file I/O, image decoding, mesh
+// parsing and welding) on a thread pool. Results are handed back to the GL
+// thread, which finishes them (e.g. uploads them to the GPU) within a
+// per-frame time budget.
+class AssetLoader {
+public:
+  AssetLoader();
+  ~AssetLoader();
+
+  AssetLoader(const AssetLoader&) = delete;
+  AssetLoader& operator=(const AssetLoader&) = delete;
+
+  // Calls load() on a worker thread, and later finish() with its result on
+  // the thread calling finish_ready()
+  template <typename Load, typename Finish>
+  void load(Load load, Finish finish) {
+    submit([load, finish]() mutable -> std::function<void()> {
+      auto result = std::make_shared<decltype(load())>(load());
+      return [result, finish]() mutable { finish(*result); };
+    });
+  }
+
+  // Finishes loaded assets until budget_ns nanoseconds have passed. At least
+  // one asset is finished if any is ready, so that loading always progresses.
+  // Returns the number of assets finished.
+  int finish_ready(qint64 budget_ns);
+
+  // Number of assets submitted but not finished yet
+  int pending() const;
+
+private:
+  class Task;
+
+  void submit(std::function<std::function<void()>()> work);
+
+  mutable std::mutex mutex;
+  std::deque<std::function<void()>> ready;
+  int pending_count = 0;
+
+  // Declared last, so that workers are done before anything else is destroyed
+  QThreadPool pool;
+};
+
+#endif // ASSET_LOADER_H
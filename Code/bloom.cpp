@@ -0,0 +1,77 @@
+#include <algorithm>
+
+#include "bloom.h"
+#include "gl_state.h"
+
+Bloom::Bloom(const BloomSettings& settings)
+    : bloom_settings(settings),
+      downsample_shader(":/shaders/vertshader_screen.glsl",
+                        ":/shaders/fragshader_bloom_downsample.glsl"),
+      upsample_shader(":/shaders/vertshader_screen.glsl",
+                      ":/shaders/fragshader_bloom_upsample.glsl") {
+  initializeOpenGLFunctions();
+
+  downsample_shader.uniform("source", 0);
+  upsample_shader.uniform("source", 0);
+  upsample_shader.uniform("radius", bloom_settings.radius);
+}
+
+void Bloom::resize(unsigned width, unsigned height) {
+  levels.clear();
+  for (int i = 0; i < bloom_settings.iterations; ++i) {
+    if (width <= 1 && height <= 1) {
+      break;
+    }
+    width = std::max(width / 2, 1u);
+    height = std::max(height / 2, 1u);
+
+    Texture texture(width, height, bloom_settings.format, GL_FLOAT, GL_RGB);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    Framebuffer framebuf;
+    framebuf.attach_color(texture);
+    framebuf.finalize();
+    levels.push_back({width, height, std::move(texture), std::move(framebuf)});
+  }
+}
+
+Texture& Bloom::apply(Texture& bright, Mesh& quad) {
+  if (levels.empty()) {
+    return bright;
+  }
+  auto& state = GLState::current();
+  state.active_texture(0);
+  state.set_enabled(GL_BLEND, false);
+
+  // Each level replaces all of its texels, so nothing is cleared
+  auto* source = &bright;
+  for (auto& level : levels) {
+    state.viewport(0, 0, level.width, level.height);
+    level.framebuf.bind();
+    source->bind();
+    downsample_shader.draw(quad);
+    source = &level.texture;
+  }
+
+  state.set_enabled(GL_BLEND, true);
+  glBlendFunc(GL_ONE, GL_ONE);
+  for (auto level = levels.size() - 1; level > 0; --level) {
+    auto& target = levels[level - 1];
+    state.viewport(0, 0, target.width, target.height);
+    target.framebuf.bind();
+    levels[level].texture.bind();
+    upsample_shader.draw(quad);
+  }
+  state.set_enabled(GL_BLEND, false);
+
+  return levels.front().texture;
+}
+
+RenderStats Bloom::take_render_stats() {
+  auto stats = downsample_shader.take_render_stats();
+  stats += upsample_shader.take_render_stats();
+  return stats;
+}
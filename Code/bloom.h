@@ -0,0 +1,59 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <vector>
+
+#include "framebuffer.h"
+#include "mesh.h"
+#include "shader.h"
+#include "texture.h"
+
+struct BloomSettings {
+  // Downsampled levels, each halving the resolution and widening the bloom
+  int iterations = 5;
+  // Spread of the upsampling tent filter, in texels of the level it reads
+  float radius = 1.0f;
+  // Weight of the bloom when added to the frame, the levels add up
+  float strength = 0.2f;
+  // Luminance above which pixels bloom
+  float threshold = 3.0f;
+  // Format of the levels, bloom needs neither alpha nor a sign
+  GLenum format = GL_R11F_G11F_B10F;
+};
+
+// Blurs the bright parts of a frame through a chain of downsampled textures.
+// Each level is filtered down from the one above it, then the levels are
+// filtered back up with a tent filter, each adding itself to the level above.
+// Every level takes a quarter of the texels of the one above it, so the whole
+// chain costs about a third of a pass at half resolution.
+class Bloom : protected QOpenGLFunctions_3_3_Core {
+public:
+  explicit Bloom(const BloomSettings& settings);
+
+  const BloomSettings& settings() const { return bloom_settings; }
+
+  // Reallocates the levels for frames of the given size
+  void resize(unsigned width, unsigned height);
+
+  // Returns the bloom of the bright parts of a frame at half its resolution.
+  // Changes the viewport and the bound framebuffer.
+  Texture& apply(Texture& bright, Mesh& quad);
+
+  // Of both shaders, since the last call
+  RenderStats take_render_stats();
+
+private:
+  struct Level {
+    unsigned width, height;
+    Texture texture;
+    Framebuffer framebuf;
+  };
+
+  BloomSettings bloom_settings;
+  ShaderInstance downsample_shader, upsample_shader;
+  std::vector<Level> levels;
+};
+
+#endif // BLOOM_H
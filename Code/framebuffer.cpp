@@ -2,6 +2,7 @@
 #include <cassert>
 
 #include "framebuffer.h"
+#include "gl_state.h"
 
 Renderbuffer::Renderbuffer(unsigned width, unsigned height, GLuint format) {
   initializeOpenGLFunctions();
@@ -23,10 +24,32 @@ Framebuffer::Framebuffer() {
   glGenFramebuffers(1, &fbo);
 }
 
-Framebuffer::~Framebuffer() { glDeleteFramebuffers(1, &fbo); }
-void Framebuffer::swap(Framebuffer&& other) { std::swap(fbo, other.fbo); }
-void Framebuffer::bind() { glBindFramebuffer(GL_FRAMEBUFFER, fbo); }
-void Framebuffer::unbind() { glBindFramebuffer(GL_FRAMEBUFFER, 0); }
+Framebuffer::~Framebuffer() {
+  if (fbo) {
+    GLState::current().deleted_framebuffer(fbo);
+  }
+  glDeleteFramebuffers(1, &fbo);
+}
+void Framebuffer::swap(Framebuffer&& other) {
+  std::swap(color_attachments, other.color_attachments);
+  std::swap(fbo, other.fbo);
+}
+void Framebuffer::bind() {
+  GLState::current().bind_framebuffer(GL_FRAMEBUFFER, fbo);
+}
+void Framebuffer::unbind() {
+  GLState::current().bind_framebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void Framebuffer::blit_depth(Framebuffer& destination, GLint width,
+                             GLint height) {
+  auto& state = GLState::current();
+  state.bind_framebuffer(GL_READ_FRAMEBUFFER, fbo);
+  state.bind_framebuffer(GL_DRAW_FRAMEBUFFER, destination.fbo);
+  glBlitFramebuffer(0, 0, width, height, 0, 0, width, height,
+                    GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+  destination.bind();
+}
 
 void Framebuffer::attach_color(Texture& texture) {
   bind();
@@ -48,6 +71,12 @@ void Framebuffer::attach_depth(Renderbuffer& buf) {
                             GL_RENDERBUFFER, buf.gl_handle());
 }
 
+void Framebuffer::attach_depth_layer(GLuint texture_array, GLint layer) {
+  bind();
+  glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture_array,
+                            0, layer);
+}
+
 void Framebuffer::finalize() {
   bind();
   if (color_attachments.empty()) {
@@ -42,6 +42,8 @@ public:
   void attach_color(Texture& texture);
   void attach_depth(Texture& buf);
   void attach_depth(Renderbuffer& buf);
+  // Attaches a layer of a depth texture array
+  void attach_depth_layer(GLuint texture_array, GLint layer);
   void finalize();
 
   void swap(Framebuffer&& other);
@@ -61,6 +63,10 @@ public:
   void bind();
   void unbind();
 
+  // Copies the depth attachment into that of a framebuffer with the same
+  // depth format, which is left bound
+  void blit_depth(Framebuffer& destination, GLint width, GLint height);
+
 private:
   std::vector<GLenum> color_attachments;
   GLuint fbo = 0;
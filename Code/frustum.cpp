@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FRUSTUM_USE_SSE2
+#endif
+
+#include "frustum.h"
+
+Frustum::Frustum(const QMatrix4x4& view_projection) {
+  // Gribb and Hartmann: each plane is the last row plus or minus another
+  auto x = view_projection.row(0), y = view_projection.row(1),
+       z = view_projection.row(2), w = view_projection.row(3);
+  planes[0] = w + x;
+  planes[1] = w - x;
+  planes[2] = w + y;
+  planes[3] = w - y;
+  planes[4] = w + z;
+  planes[5] = w - z;
+  for (auto& plane : planes) {
+    auto length = plane.toVector3D().length();
+    if (length > 0.0f) {
+      plane /= length;
+    }
+  }
+}
+
+void BoundsBatch::clear() {
+  for (auto* values : {&center_x, &center_y, &center_z, &extent_x, &extent_y,
+                       &extent_z, &radius}) {
+    values->clear();
+  }
+}
+
+void BoundsBatch::add(const BoundingBox& box, float radius,
+                      const QMatrix4x4& model, float padding) {
+  auto center = model.map(box.center());
+  auto half = box.half_extents() + QVector3D(padding, padding, padding);
+
+  // The world box encloses the rotated local box, each of its half extents
+  // sums the local ones projected onto that axis
+  float extents[3];
+  float max_scale = 0.0f;
+  for (int axis = 0; axis < 3; ++axis) {
+    extents[axis] = std::abs(model(axis, 0)) * half.x() +
+                    std::abs(model(axis, 1)) * half.y() +
+                    std::abs(model(axis, 2)) * half.z();
+    max_scale =
+        std::max(max_scale, model.column(axis).toVector3D().length());
+  }
+
+  center_x.push_back(center.x());
+  center_y.push_back(center.y());
+  center_z.push_back(center.z());
+  extent_x.push_back(extents[0]);
+  extent_y.push_back(extents[1]);
+  extent_z.push_back(extents[2]);
+  this->radius.push_back((radius + std::sqrt(3.0f) * padding) * max_scale);
+}
+
+void BoundsBatch::cull(const Frustum& frustum,
+                       std::vector<std::uint8_t>& visible) const {
+  auto count = size();
+  visible.assign(count, 1);
+
+  std::size_t i = 0;
+#ifdef FRUSTUM_USE_SSE2
+  const __m128 sign_mask = _mm_set1_ps(-0.0f);
+  for (; i + 4 <= count; i += 4) {
+    auto cx = _mm_loadu_ps(&center_x[i]);
+    auto cy = _mm_loadu_ps(&center_y[i]);
+    auto cz = _mm_loadu_ps(&center_z[i]);
+    auto ex = _mm_loadu_ps(&extent_x[i]);
+    auto ey = _mm_loadu_ps(&extent_y[i]);
+    auto ez = _mm_loadu_ps(&extent_z[i]);
+    auto r = _mm_loadu_ps(&radius[i]);
+
+    auto outside = _mm_setzero_ps();
+    for (const auto& plane : frustum.planes) {
+      auto nx = _mm_set1_ps(plane.x()), ny = _mm_set1_ps(plane.y()),
+           nz = _mm_set1_ps(plane.z());
+      auto distance = _mm_add_ps(
+          _mm_add_ps(_mm_mul_ps(nx, cx), _mm_mul_ps(ny, cy)),
+          _mm_add_ps(_mm_mul_ps(nz, cz), _mm_set1_ps(plane.w())));
+      auto box_radius =
+          _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(sign_mask, nx), ex),
+                                _mm_mul_ps(_mm_andnot_ps(sign_mask, ny), ey)),
+                     _mm_mul_ps(_mm_andnot_ps(sign_mask, nz), ez));
+      auto reach = _mm_add_ps(distance, _mm_min_ps(box_radius, r));
+      outside = _mm_or_ps(outside, _mm_cmplt_ps(reach, _mm_setzero_ps()));
+    }
+
+    int mask = _mm_movemask_ps(outside);
+    for (int lane = 0; lane < 4; ++lane) {
+      visible[i + lane] = !(mask & (1 << lane));
+    }
+  }
+#endif
+  for (; i < count; ++i) {
+    for (const auto& plane : frustum.planes) {
+      float distance = plane.x() * center_x[i] + plane.y() * center_y[i] +
+                       plane.z() * center_z[i] + plane.w();
+      float box_radius = std::abs(plane.x()) * extent_x[i] +
+                         std::abs(plane.y()) * extent_y[i] +
+                         std::abs(plane.z()) * extent_z[i];
+      if (distance + std::min(box_radius, radius[i]) < 0.0f) {
+        visible[i] = 0;
+        break;
+      }
+    }
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+#include <cstdint>
+#include <vector>
+
+struct BoundingBox {
+  QVector3D min, max;
+
+  QVector3D center() const { return (min + max) / 2.0f; }
+  QVector3D half_extents() const { return (max - min) / 2.0f; }
+};
+
+struct BoundingSphere {
+  QVector3D center;
+  float radius = 0.0f;
+};
+
+// The six planes bounding the clip volume of a view-projection matrix, with
+// normalized normals pointing inwards
+struct Frustum {
+  explicit Frustum(const QMatrix4x4& view_projection);
+
+  QVector4D planes[6];
+};
+
+// World-space bounds of many instances, stored as structures of arrays so
+// that they are tested against the frustum planes four at a time. Each
+// instance is bounded by a box and a sphere around the same center, and
+// whichever of the two is tighter against a plane decides.
+class BoundsBatch {
+public:
+  void clear();
+
+  // Adds an instance from its local bounds, whose sphere is centered on the
+  // box, transformed by its model matrix. Padding grows the local box on all
+  // sides and the sphere along with its corners, for vertices that shaders
+  // move before transforming them.
+  void add(const BoundingBox& box, float radius, const QMatrix4x4& model,
+           float padding = 0.0f);
+
+  std::size_t size() const { return center_x.size(); }
+
+  // Sets visible[i] to whether instance i intersects the frustum
+  void cull(const Frustum& frustum, std::vector<std::uint8_t>& visible) const;
+
+private:
+  std::vector<float> center_x, center_y, center_z;
+  std::vector<float> extent_x, extent_y, extent_z;
+  std::vector<float> radius;
+};
+
+#endif // FRUSTUM_H
@@ -0,0 +1,276 @@
+#include <QDebug>
+#include <QHash>
+
+#include "gl_state.h"
+
+constexpr unsigned GLState::texture_units;
+constexpr GLuint GLState::unknown;
+
+GLState& GLState::current() {
+  // Trackers of the contexts alive, dropped as their context is destroyed
+  static QHash<QOpenGLContext*, GLState*> states;
+  // Nearly every call is for the context of the call before
+  static QOpenGLContext* last_context = nullptr;
+  static GLState* last_state = nullptr;
+
+  auto* context = QOpenGLContext::currentContext();
+  if (context == last_context && last_state) {
+    return *last_state;
+  }
+  auto*& state = states[context];
+  if (!state) {
+    state = new GLState();
+    QObject::connect(context, &QOpenGLContext::aboutToBeDestroyed, [context] {
+      if (context == last_context) {
+        last_state = nullptr;
+      }
+      delete states.take(context);
+    });
+  }
+  last_context = context;
+  last_state = state;
+  return *state;
+}
+
+GLState::GLState() {
+  initializeOpenGLFunctions();
+  invalidate();
+}
+
+void GLState::invalidate() {
+  program = unknown;
+  vertex_array = unknown;
+  draw_framebuffer = read_framebuffer = unknown;
+  active_unit = unknown;
+  units.fill(TextureUnit());
+  viewport_rect.fill(-1);
+  depth_test = cull_face = blend = -1;
+}
+
+bool GLState::use_program(GLuint handle) {
+  if (handle == program) {
+    if (validation) {
+      check(GL_CURRENT_PROGRAM, program, "program");
+    }
+    return false;
+  }
+  glUseProgram(handle);
+  program = handle;
+  return true;
+}
+
+bool GLState::bind_vertex_array(GLuint vao) {
+  if (vao == vertex_array) {
+    if (validation) {
+      check(GL_VERTEX_ARRAY_BINDING, vertex_array, "vertex array");
+    }
+    return false;
+  }
+  glBindVertexArray(vao);
+  vertex_array = vao;
+  return true;
+}
+
+bool GLState::bind_framebuffer(GLenum target, GLuint fbo) {
+  bool draw = target != GL_READ_FRAMEBUFFER;
+  bool read = target != GL_DRAW_FRAMEBUFFER;
+  if ((!draw || fbo == draw_framebuffer) &&
+      (!read || fbo == read_framebuffer)) {
+    if (validation && draw) {
+      check(GL_DRAW_FRAMEBUFFER_BINDING, fbo, "draw framebuffer");
+    }
+    if (validation && read) {
+      check(GL_READ_FRAMEBUFFER_BINDING, fbo, "read framebuffer");
+    }
+    return false;
+  }
+  glBindFramebuffer(target, fbo);
+  if (draw) {
+    draw_framebuffer = fbo;
+  }
+  if (read) {
+    read_framebuffer = fbo;
+  }
+  return true;
+}
+
+bool GLState::active_texture(unsigned unit) {
+  if (unit == active_unit) {
+    if (validation) {
+      check(GL_ACTIVE_TEXTURE, GL_TEXTURE0 + unit, "active texture unit");
+    }
+    return false;
+  }
+  glActiveTexture(GL_TEXTURE0 + unit);
+  active_unit = unit;
+  return true;
+}
+
+bool GLState::bind_texture(GLenum target, GLuint texture) {
+  auto* binding = texture_binding(active_unit, target);
+  if (binding && *binding == texture) {
+    if (validation) {
+      check(target == GL_TEXTURE_2D ? GL_TEXTURE_BINDING_2D
+                                    : GL_TEXTURE_BINDING_2D_ARRAY,
+            texture, "texture");
+    }
+    return false;
+  }
+  glBindTexture(target, texture);
+  if (binding) {
+    *binding = texture;
+  }
+  return true;
+}
+
+bool GLState::bind_texture(unsigned unit, GLenum target, GLuint texture) {
+  active_texture(unit);
+  return bind_texture(target, texture);
+}
+
+bool GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+  std::array<GLint, 4> rect = {{x, y, width, height}};
+  if (rect == viewport_rect) {
+    if (validation) {
+      std::array<GLint, 4> actual;
+      glGetIntegerv(GL_VIEWPORT, actual.data());
+      if (actual != viewport_rect) {
+        qDebug() << ":: GL state of the viewport differs from the tracked one";
+      }
+    }
+    return false;
+  }
+  glViewport(x, y, width, height);
+  viewport_rect = rect;
+  return true;
+}
+
+bool GLState::set_enabled(GLenum capability, bool enabled) {
+  auto* state = enabled_state(capability);
+  if (state && *state == GLint(enabled)) {
+    if (validation) {
+      check_enabled(capability, *state, "enabled capability");
+    }
+    return false;
+  }
+  if (enabled) {
+    glEnable(capability);
+  } else {
+    glDisable(capability);
+  }
+  if (state) {
+    *state = enabled;
+  }
+  return true;
+}
+
+void GLState::deleted_program(GLuint handle) {
+  // A program stays in use after it is deleted, but its name can be reused
+  if (handle == program) {
+    program = unknown;
+  }
+}
+
+void GLState::deleted_vertex_array(GLuint vao) {
+  if (vao == vertex_array) {
+    vertex_array = 0;
+  }
+}
+
+void GLState::deleted_framebuffer(GLuint fbo) {
+  if (fbo == draw_framebuffer) {
+    draw_framebuffer = 0;
+  }
+  if (fbo == read_framebuffer) {
+    read_framebuffer = 0;
+  }
+}
+
+void GLState::deleted_texture(GLuint texture) {
+  for (auto& unit : units) {
+    if (texture == unit.texture_2d) {
+      unit.texture_2d = 0;
+    }
+    if (texture == unit.texture_2d_array) {
+      unit.texture_2d_array = 0;
+    }
+  }
+}
+
+void GLState::validate() {
+  if (!validation) {
+    return;
+  }
+  check(GL_CURRENT_PROGRAM, program, "program");
+  check(GL_VERTEX_ARRAY_BINDING, vertex_array, "vertex array");
+  check(GL_DRAW_FRAMEBUFFER_BINDING, draw_framebuffer, "draw framebuffer");
+  check(GL_READ_FRAMEBUFFER_BINDING, read_framebuffer, "read framebuffer");
+  if (active_unit != unknown) {
+    check(GL_ACTIVE_TEXTURE, GL_TEXTURE0 + active_unit, "active texture unit");
+  }
+  check_enabled(GL_DEPTH_TEST, depth_test, "depth test");
+  check_enabled(GL_CULL_FACE, cull_face, "face culling");
+  check_enabled(GL_BLEND, blend, "blending");
+
+  // Bindings are read from the active unit, which is restored afterwards
+  GLint active = 0;
+  glGetIntegerv(GL_ACTIVE_TEXTURE, &active);
+  for (unsigned unit = 0; unit < texture_units; ++unit) {
+    glActiveTexture(GL_TEXTURE0 + unit);
+    check(GL_TEXTURE_BINDING_2D, units[unit].texture_2d, "2D texture");
+    check(GL_TEXTURE_BINDING_2D_ARRAY, units[unit].texture_2d_array,
+          "texture array");
+  }
+  glActiveTexture(active);
+}
+
+GLuint* GLState::texture_binding(unsigned unit, GLenum target) {
+  if (unit >= texture_units) {
+    return nullptr;
+  }
+  switch (target) {
+  case GL_TEXTURE_2D:
+    return &units[unit].texture_2d;
+  case GL_TEXTURE_2D_ARRAY:
+    return &units[unit].texture_2d_array;
+  default:
+    return nullptr;
+  }
+}
+
+GLint* GLState::enabled_state(GLenum capability) {
+  switch (capability) {
+  case GL_DEPTH_TEST:
+    return &depth_test;
+  case GL_CULL_FACE:
+    return &cull_face;
+  case GL_BLEND:
+    return &blend;
+  default:
+    return nullptr;
+  }
+}
+
+void GLState::check(GLenum parameter, GLuint expected, const char* name) {
+  if (expected == unknown) {
+    return;
+  }
+  GLint actual = 0;
+  glGetIntegerv(parameter, &actual);
+  if (GLuint(actual) != expected) {
+    qDebug() << ":: GL state of the" << name << "is" << actual
+             << "but was tracked as" << expected;
+  }
+}
+
+void GLState::check_enabled(GLenum capability, GLint expected,
+                            const char* name) {
+  if (expected == -1) {
+    return;
+  }
+  GLint actual = glIsEnabled(capability);
+  if (actual != expected) {
+    qDebug() << ":: GL state of the" << name << "is" << actual
+             << "but was tracked as" << expected;
+  }
+}
@@ -0,0 +1,86 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <array>
+
+// Shadow of the GL state of a context that drawing changes all the time: the
+// program, vertex array, framebuffers, texture bindings, viewport and the
+// enables drawing toggles. Setting state to what it already is skips the GL
+// call, and the bound state is read from the shadow rather than the driver.
+//
+// Every change of this state must go through the tracker, and deleting an
+// object bound somewhere must be reported, as GL then binds zero in its place.
+// State the tracker did not set is unknown, and the next change of it always
+// reaches GL.
+class GLState : protected QOpenGLFunctions_3_3_Core {
+public:
+  // Texture units tracked, units above are bound without filtering
+  static constexpr unsigned texture_units = 8;
+
+  // Of the current context, created on first use
+  static GLState& current();
+
+  GLState(const GLState&) = delete;
+  GLState& operator=(const GLState&) = delete;
+
+  // Forgets all state, for when code outside of the tracker may have changed
+  // it, as Qt does between frames
+  void invalidate();
+
+  // Each returns whether the state changed, and so a GL call was made
+  bool use_program(GLuint program);
+  bool bind_vertex_array(GLuint vao);
+  // Binds to GL_FRAMEBUFFER, GL_DRAW_FRAMEBUFFER or GL_READ_FRAMEBUFFER
+  bool bind_framebuffer(GLenum target, GLuint fbo);
+  bool active_texture(unsigned unit);
+  // Binds a GL_TEXTURE_2D or GL_TEXTURE_2D_ARRAY to the active unit
+  bool bind_texture(GLenum target, GLuint texture);
+  bool bind_texture(unsigned unit, GLenum target, GLuint texture);
+  bool viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+  // GL_DEPTH_TEST, GL_CULL_FACE or GL_BLEND
+  bool set_enabled(GLenum capability, bool enabled);
+
+  // Deleted objects, unbound wherever GL unbinds them
+  void deleted_program(GLuint program);
+  void deleted_vertex_array(GLuint vao);
+  void deleted_framebuffer(GLuint fbo);
+  void deleted_texture(GLuint texture);
+
+  // Whether every filtered call and validate() compare the shadow to the
+  // state GL reports, logging where they differ. Each comparison waits on the
+  // driver, so only for debugging.
+  void set_validation(bool enabled) { validation = enabled; }
+  void validate();
+
+private:
+  // Of state the tracker has not set since it was last invalidated
+  static constexpr GLuint unknown = GLuint(-1);
+
+  struct TextureUnit {
+    GLuint texture_2d = unknown;
+    GLuint texture_2d_array = unknown;
+  };
+
+  GLState();
+
+  GLuint* texture_binding(unsigned unit, GLenum target);
+  GLint* enabled_state(GLenum capability);
+  // Logs when GL reports another value for a parameter than the shadow
+  void check(GLenum parameter, GLuint expected, const char* name);
+  void check_enabled(GLenum capability, GLint expected, const char* name);
+
+  GLuint program;
+  GLuint vertex_array;
+  GLuint draw_framebuffer, read_framebuffer;
+  unsigned active_unit;
+  std::array<TextureUnit, texture_units> units;
+  std::array<GLint, 4> viewport_rect;
+  // 1 or 0, or unknown as -1
+  GLint depth_test, cull_face, blend;
+  bool validation = false;
+};
+
+#endif // GL_STATE_H
@@ -0,0 +1,201 @@
+#include <QDebug>
+#include <QImage>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IMAGE_USE_SSE2
+#endif
+
+#include "image.h"
+
+namespace {
+// Converts a row of 0xAARRGGBB pixels, stored as B, G, R, A bytes on
+// little-endian machines, into R, G, B, A bytes by swapping red and blue
+void swizzle_argb_row(const std::uint32_t* in, std::uint8_t* out,
+                      unsigned width) {
+  unsigned x = 0;
+#ifdef IMAGE_USE_SSE2
+  const __m128i green_alpha = _mm_set1_epi32(0xff00ff00);
+  const __m128i low_byte = _mm_set1_epi32(0x000000ff);
+  for (; x + 4 <= width; x += 4) {
+    __m128i pixels =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x));
+    __m128i red = _mm_and_si128(_mm_srli_epi32(pixels, 16), low_byte);
+    __m128i blue = _mm_slli_epi32(_mm_and_si128(pixels, low_byte), 16);
+    __m128i swapped = _mm_or_si128(_mm_and_si128(pixels, green_alpha),
+                                   _mm_or_si128(red, blue));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x * 4), swapped);
+  }
+#endif
+  for (; x < width; ++x) {
+    std::uint32_t pixel = in[x];
+    out[x * 4 + 0] = static_cast<std::uint8_t>(pixel >> 16);
+    out[x * 4 + 1] = static_cast<std::uint8_t>(pixel >> 8);
+    out[x * 4 + 2] = static_cast<std::uint8_t>(pixel);
+    out[x * 4 + 3] = static_cast<std::uint8_t>(pixel >> 24);
+  }
+}
+
+const std::array<float, 256>& srgb_to_linear_table() {
+  static const auto table = [] {
+    std::array<float, 256> values;
+    for (int i = 0; i < 256; ++i) {
+      float value = i / 255.0f;
+      values[i] = value <= 0.04045f
+                      ? value / 12.92f
+                      : std::pow((value + 0.055f) / 1.055f, 2.4f);
+    }
+    return values;
+  }();
+  return table;
+}
+
+// Indexed by linear values scaled to 12 bits, fine enough to round-trip all
+// 8-bit sRGB values
+const std::array<std::uint8_t, 4096>& linear_to_srgb_table() {
+  static const auto table = [] {
+    std::array<std::uint8_t, 4096> values;
+    for (int i = 0; i < 4096; ++i) {
+      float value = i / 4095.0f;
+      value = value <= 0.0031308f
+                  ? value * 12.92f
+                  : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+      values[i] = static_cast<std::uint8_t>(value * 255.0f + 0.5f);
+    }
+    return values;
+  }();
+  return table;
+}
+} // namespace
+
+std::vector<std::uint8_t> image_to_rgba(const QImage& image) {
+  auto width = static_cast<unsigned>(image.width());
+  auto height = static_cast<unsigned>(image.height());
+  std::vector<std::uint8_t> data(std::size_t(width) * height * 4);
+  auto row_bytes = std::size_t(width) * 4;
+
+  // Rows are written bottom to top, since (0,0) is bottom left in OpenGL
+  auto format = image.format();
+  bool is_argb = (format == QImage::Format_ARGB32 ||
+                  format == QImage::Format_RGB32) &&
+                 Q_BYTE_ORDER == Q_LITTLE_ENDIAN;
+  if (is_argb) {
+    for (unsigned y = 0; y < height; ++y) {
+      swizzle_argb_row(
+          reinterpret_cast<const std::uint32_t*>(image.constScanLine(y)),
+          data.data() + (height - 1 - y) * row_bytes, width);
+    }
+    return data;
+  }
+
+  // Everything else goes through a single conversion by Qt
+  const QImage rgba = format == QImage::Format_RGBA8888
+                          ? image
+                          : image.convertToFormat(QImage::Format_RGBA8888);
+  for (unsigned y = 0; y < height; ++y) {
+    std::memcpy(data.data() + (height - 1 - y) * row_bytes,
+                rgba.constScanLine(y), row_bytes);
+  }
+  return data;
+}
+
+std::vector<std::uint8_t> image_to_bytes_per_pixel(const QImage& image) {
+  // needed since (0,0) is bottom left in OpenGL
+  QImage im = image.mirrored();
+  std::vector<std::uint8_t> data;
+  data.reserve(im.width() * im.height() * 4);
+
+  for (int i = 0; i != im.height(); ++i) {
+    for (int j = 0; j != im.width(); ++j) {
+      QRgb pixel = im.pixel(j, i);
+
+      // pixel is of format #AARRGGBB (in hexadecimal notation)
+      // so with bitshifting and binary AND you can get
+      // the values of the different components
+      std::uint8_t r = (std::uint8_t)((pixel >> 16) & 0xFF); // Red component
+      std::uint8_t g = (std::uint8_t)((pixel >> 8) & 0xFF);  // Green component
+      std::uint8_t b = (std::uint8_t)(pixel & 0xFF);         // Blue component
+      std::uint8_t a = (std::uint8_t)((pixel >> 24) & 0xFF); // Alpha component
+
+      // Add them to the Vector
+      data.push_back(r);
+      data.push_back(g);
+      data.push_back(b);
+      data.push_back(a);
+    }
+  }
+  return data;
+}
+
+namespace {
+Image from_qimage(const QImage& img) {
+  Image image;
+  image.width = img.width();
+  image.height = img.height();
+  image.pixels = image_to_rgba(img);
+  return image;
+}
+} // namespace
+
+Image load_image(const QString& path) {
+  QImage img(path);
+  if (img.isNull()) {
+    qDebug() << "Error loading texture:" << path;
+  }
+  return from_qimage(img);
+}
+
+Image decode_image(const char* data, qint64 size) {
+  QImage img;
+  if (!img.loadFromData(reinterpret_cast<const uchar*>(data),
+                        static_cast<int>(size))) {
+    qDebug() << "Error decoding image";
+  }
+  return from_qimage(img);
+}
+
+Image downsample_image(const Image& image) {
+  const auto& to_linear = srgb_to_linear_table();
+  const auto& to_srgb = linear_to_srgb_table();
+
+  Image half;
+  half.width = std::max(image.width / 2, 1u);
+  half.height = std::max(image.height / 2, 1u);
+  half.pixels.resize(std::size_t(half.width) * half.height * 4);
+
+  // Odd sizes repeat the last row or column
+  for (unsigned y = 0; y < half.height; ++y) {
+    unsigned y0 = std::min(y * 2, image.height - 1);
+    unsigned y1 = std::min(y * 2 + 1, image.height - 1);
+    for (unsigned x = 0; x < half.width; ++x) {
+      unsigned x0 = std::min(x * 2, image.width - 1);
+      unsigned x1 = std::min(x * 2 + 1, image.width - 1);
+      const std::uint8_t* texels[4] = {
+          &image.pixels[(std::size_t(y0) * image.width + x0) * 4],
+          &image.pixels[(std::size_t(y0) * image.width + x1) * 4],
+          &image.pixels[(std::size_t(y1) * image.width + x0) * 4],
+          &image.pixels[(std::size_t(y1) * image.width + x1) * 4]};
+
+      auto out = &half.pixels[(std::size_t(y) * half.width + x) * 4];
+      for (int c = 0; c < 3; ++c) {
+        float sum = 0.0f;
+        for (auto texel : texels) {
+          sum += to_linear[texel[c]];
+        }
+        out[c] = to_srgb[static_cast<int>(sum / 4.0f * 4095.0f + 0.5f)];
+      }
+      // Alpha is linear already
+      unsigned alpha = 0;
+      for (auto texel : texels) {
+        alpha += texel[3];
+      }
+      out[3] = static_cast<std::uint8_t>((alpha + 2) / 4);
+    }
+  }
+  return half;
+}
@@ -0,0 +1,32 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <QString>
+
+#include <cstdint>
+#include <vector>
+
+class QImage;
+
+// Decoded RGBA8 pixels, with the first row at the bottom as OpenGL expects
+struct Image {
+  unsigned width = 0, height = 0;
+  std::vector<std::uint8_t> pixels;
+};
+
+Image load_image(const QString& path);
+
+// Decodes the contents of an image file held in memory
+Image decode_image(const char* data, qint64 size);
+
+// Halves the size of an sRGB image, averaging 2x2 texels in linear space as
+// glGenerateMipmap does
+Image downsample_image(const Image& image);
+
+// Converts to RGBA8 with the bottom row first, a scanline at a time
+std::vector<std::uint8_t> image_to_rgba(const QImage& image);
+
+// The original conversion through QImage::pixel, kept as a benchmark baseline
+std::vector<std::uint8_t> image_to_bytes_per_pixel(const QImage& image);
+
+#endif // IMAGE_H
@@ -1,11 +1,54 @@
 #include <QDateTime>
 #include <cmath>
+#include <iterator>
+#include <numeric>
 
+#include "gl_state.h"
 #include "mainview.h"
+#include "memory_usage.h"
 #include "mesh.h"
 
 constexpr float frame_time = 1000.0f / 60.0f;
-constexpr float shadow_map_size = 2048;
+// Time per frame spent uploading assets which finished loading
+constexpr qint64 asset_upload_budget_ns = 4000000;
+// Texture data streamed to the GPU per frame, larger textures take several
+// frames to appear
+constexpr std::size_t texture_upload_budget = 8 << 20;
+// Video memory for material textures, beyond which mip levels finer than the
+// meshes on screen need are dropped
+constexpr std::size_t texture_memory_budget = std::size_t(256) << 20;
+// Layout of the scene's vertex buffers, packed formats halve their size
+constexpr VertexFormat mesh_vertex_format = VertexFormat::Packed;
+// Whether material textures of the same format and size share a texture
+// array, which saves binding textures between meshes
+constexpr bool pack_texture_arrays = true;
+// Uniform blocks written per frame, the ring grows when frames need more
+constexpr std::size_t uniform_ring_frame_size = 256 << 10;
+// Shadow map cascades from near to far, which share a depth texture array of
+// the largest resolution. Three cascades of at most 1024 texels take fewer
+// texels than a single map of 2048.
+constexpr unsigned shadow_map_size = 1024;
+const std::vector<ShadowCascadeSettings> shadow_cascades = {
+    {1024, 1}, {1024, 2}, {512, 4}};
+// View depth up to which meshes are shadowed
+constexpr float shadow_distance = 20.0f;
+// Screen-space error allowed for mesh LODs in pixels, shadows get away with
+// coarser meshes than the camera
+constexpr float camera_lod_pixel_error = 1.0f;
+constexpr float shadow_lod_pixel_error = 4.0f;
+// Chunks per side of the ocean, each picks its own level of detail
+constexpr unsigned ocean_chunks = 4;
+const BloomSettings bloom_settings = {5, 1.0f, 0.2f, 3.0f, GL_R11F_G11F_B10F};
+// Whether the phong pass writes the bright parts of the frame for the bloom
+// into a second render target, instead of a separate pass extracting them
+constexpr bool fuse_bright_pass = true;
+// Whether the GL state tracker compares its state to that of GL, which waits
+// on the driver for every call it filters
+constexpr bool validate_gl_state = false;
+// Frames between logs of the render stats, every five seconds
+constexpr unsigned stats_log_interval = 300;
+// Spreads the wave phases of instances
+constexpr float golden_ratio_conjugate = 0.618034f;
 static auto sky_color = QVector3D(0.2f, 0.8f, 1.0f) * 10.0f;
 
 /**
@@ -15,7 +58,9 @@ static auto sky_color = QVector3D(0.2f, 0.8f, 1.0f) * 10.0f;
  *
  * @param parent
  */
-MainView::MainView(QWidget* parent) : QOpenGLWidget(parent) {
+MainView::MainView(QWidget* parent)
+    : QOpenGLWidget(parent), textures(pack_texture_arrays),
+      texture_streaming(textures, assets, texture_memory_budget) {
   connect(&timer, SIGNAL(timeout()), this, SLOT(update()));
 }
 
@@ -57,16 +102,26 @@ void MainView::initializeGL() {
   glVersion = reinterpret_cast<const char*>(glGetString(GL_VERSION));
   qDebug() << ":: Using OpenGL" << qPrintable(glVersion);
 
+  auto& state = GLState::current();
+  state.set_validation(validate_gl_state);
+
+  // Without S3TC, precompressed color textures load their source images
+  textures.set_s3tc(Texture::supports_s3tc());
+  if (!textures.reads_s3tc()) {
+    qDebug() << ":: S3TC is not supported, loading source images instead";
+  }
+
   // Enable depth buffer
-  glEnable(GL_DEPTH_TEST);
+  state.set_enabled(GL_DEPTH_TEST, true);
 
   // Default is GL_LESS
   glDepthFunc(GL_LEQUAL);
 
-  glDisable(GL_CULL_FACE);
+  state.set_enabled(GL_CULL_FACE, false);
 
   glClearColor(sky_color.x(), sky_color.y(), sky_color.z(), 0.0f);
 
+  uniforms = std::make_unique<UniformRing>(uniform_ring_frame_size);
   createShaderPrograms();
   createGeometry();
 
@@ -83,25 +138,28 @@ void MainView::createShaderPrograms() {
   phong_shader->uniform("material_diffuse", 0);
   phong_shader->uniform("shadow_map", 1);
   phong_shader->uniform("wave_mask", 2);
+  phong_shader->set_mip_feedback(true);
+  phong_shader->set_uniform_ring(uniforms.get());
+  phong_shader->uniform("bright_threshold", bloom_settings.threshold);
 
   shadow_pass_shader = std::make_unique<ShaderInstance>(
       ":/shaders/vertshader_shadow.glsl", ":/shaders/fragshader_shadow.glsl");
   shadow_pass_shader->uniform("wave_mask", 2);
+  shadow_pass_shader->set_uniform_ring(uniforms.get());
+  shadow_pass_shader->set_lod_settings(
+      {float(shadow_map_size), shadow_lod_pixel_error});
 
   screen_shader = std::make_unique<ShaderInstance>(
       ":/shaders/vertshader_screen.glsl", ":/shaders/fragshader_screen.glsl");
   screen_shader->uniform("screen_texture", 0);
   screen_shader->uniform("bloom_texture", 1);
+  screen_shader->uniform("bloom_strength", bloom_settings.strength);
 
   high_pass_shader =
       std::make_unique<ShaderInstance>(":/shaders/vertshader_screen.glsl",
                                        ":/shaders/fragshader_high_pass.glsl");
-  vert_blur_shader = std::make_unique<ShaderInstance>(
-      ":/shaders/vertshader_screen.glsl",
-      ":/shaders/fragshader_blur_vertical.glsl");
-  horiz_blur_shader = std::make_unique<ShaderInstance>(
-      ":/shaders/vertshader_screen.glsl",
-      ":/shaders/fragshader_blur_horizontal.glsl");
+  high_pass_shader->uniform("bright_threshold", bloom_settings.threshold);
+  bloom = std::make_unique<Bloom>(bloom_settings);
 }
 
 void MainView::createGeometry() {
@@ -110,51 +168,117 @@ void MainView::createGeometry() {
   scene.light.pos = {0.0f, 3.0f, 1.5f};
   scene.light.color = QVector3D(0.99f, 0.72f, 0.60f) * 30.0f;
 
-  auto rugmat = std::make_shared<Material>(
-      Texture::from_file(":/textures/rug_logo.png"), 0.2f, 0.6f, 0.2f, 4.0f,
-      Texture::from_file(":/textures/blank.png"));
-
-  auto bark_mat = std::make_shared<Material>(
-      Texture::from_file(":/textures/bark.png"), 0.2f, 0.6f, 0.2f, 2.0f,
-      Texture::from_file(":/textures/blank.png"));
-  auto leaf_mat = std::make_shared<Material>(
-      Texture::from_file(":/textures/leaves.png"), 0.2f, 0.6f, 0.3f, 16.0f,
-      Texture::from_file(":/textures/leaves_mask.png"));
-  auto sand_mat = std::make_shared<Material>(
-      Texture::from_file(":/textures/sand.png"), 0.2f, 0.6f, 0.3f, 16.0f,
-      Texture::from_file(":/textures/blank.png"));
-  auto ocean_mat = std::make_shared<Material>(
-      Texture::from_file(":/textures/white.png"), 0.2f, 0.4f, 0.5f, 20.0f,
-      Texture::from_file(":/textures/gradient.png"));
-  ocean_mat->is_water = true;
-
+  // Meshes are loaded in the background, and appear in the scene as soon as
+  // they have been uploaded
   Transform transf;
   transf.position.setZ(1.0f);
-  scene.meshes.emplace_back(Mesh::from_file(":/models/bark.obj"), bark_mat,
-                            nullptr, transf);
+  load_instances(":/models/bark.obj",
+                {":/textures/bark.png", ":/textures/blank.png", 0.2f, 0.6f,
+                 0.2f, 2.0f, false, false},
+                {transf});
 
   transf = Transform();
   transf.position.setZ(+0.5f);
   transf.position.setY(0.7f);
-  scene.meshes.emplace_back(Mesh::from_file(":/models/leaves.obj"), leaf_mat,
-                            nullptr, transf);
+  load_instances(":/models/leaves.obj",
+                {":/textures/leaves.png", ":/textures/leaves_mask.png", 0.2f,
+                 0.6f, 0.3f, 16.0f, false, true},
+                {transf});
 
   transf = Transform();
   transf.scale = QVector3D(2.0f, 2.0f, 2.0f);
   transf.position.setY(-1.0f);
   transf.position.setZ(0.00f);
-  scene.meshes.emplace_back(Mesh::from_file(":/models/island.obj"), sand_mat,
-                            nullptr, transf);
+  load_instances(":/models/island.obj",
+                {":/textures/sand.png", ":/textures/blank.png", 0.2f, 0.6f,
+                 0.3f, 16.0f, false, false},
+                {transf});
 
   transf = Transform();
   transf.position.setY(-1.0f);
   transf.position.setZ(1.0f);
   transf.scale = QVector3D(50.0f, 1.0f, 50.0f);
-  scene.meshes.emplace_back(Mesh::from_file(":/models/ocean.obj"), ocean_mat,
-                            nullptr, transf);
+  // The ocean reaches far past the island, where coarser levels suffice
+  load_instances(":/models/ocean.obj",
+                {":/textures/white.png", ":/textures/gradient.png", 0.2f, 0.4f,
+                 0.5f, 20.0f, true, false},
+                {transf}, ocean_chunks);
+}
+
+void MainView::load_instances(const QString& mesh_path,
+                              const MaterialSource& material,
+                              const std::vector<Transform>& transforms,
+                              unsigned chunks) {
+  struct InstanceData {
+    std::vector<MeshData> meshes;
+    PendingTexture diffuse, wave_mask;
+  };
+
+  // Instances take the place of their call in the scene, however long the
+  // loads of earlier calls take
+  auto slot = loaded_instances.size();
+  loaded_instances.push_back(0);
+
+  assets.load(
+      [this, mesh_path, material, chunks] {
+        // Other loads keep the pool's workers busy, so the file is parsed
+        // on this one alone
+        auto mesh = load_mesh_data(mesh_path, 1);
+        std::vector<MeshData> meshes;
+        if (chunks > 1) {
+          meshes = split_mesh(mesh, chunks);
+        } else {
+          meshes.push_back(std::move(mesh));
+        }
+        return InstanceData{std::move(meshes), textures.load(material.diffuse),
+                            textures.load(material.wave_mask)};
+      },
+      [this, material, transforms, slot](InstanceData& data) {
+        auto mat = std::make_shared<Material>(
+            textures.get(data.diffuse), material.ka, material.kd, material.ks,
+            material.exp, textures.get(data.wave_mask));
+        mat->is_water = material.is_water;
+        mat->sways = material.sways;
+        // Seeds spread evenly over a wave period, and instances of different
+        // meshes at the same index match, as for the bark and leaves of a tree
+        // or the chunks of the ocean
+        std::vector<MeshInstance> instances;
+        for (const auto& data_mesh : data.meshes) {
+          auto mesh = std::make_shared<Mesh>(
+              Mesh::from_data(data_mesh, mesh_vertex_format));
+          for (std::size_t i = 0; i < transforms.size(); ++i) {
+            float seed = std::fmod(i * golden_ratio_conjugate, 1.0f);
+            instances.emplace_back(mesh, mat, nullptr, transforms[i], seed);
+          }
+        }
+        auto position = std::accumulate(loaded_instances.begin(),
+                                        loaded_instances.begin() + slot,
+                                        std::size_t(0));
+        scene.meshes.insert(scene.meshes.begin() + position,
+                            std::make_move_iterator(instances.begin()),
+                            std::make_move_iterator(instances.end()));
+        loaded_instances[slot] = instances.size();
+      });
 }
 
 void MainView::create_framebuffers(unsigned int width, unsigned int height) {
+  {
+    bright_texture = std::make_unique<Texture>(
+        width, height, bloom_settings.format, GL_FLOAT, GL_RGB);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    bright_framebuf.reset();
+    if (!fuse_bright_pass) {
+      bright_framebuf = std::make_unique<Framebuffer>();
+      bright_framebuf->attach_color(*bright_texture);
+      bright_framebuf->finalize();
+    }
+    bloom->resize(width, height);
+  }
+
   {
     framebuf = std::make_unique<Framebuffer>();
     screen_texture =
@@ -165,46 +289,16 @@ void MainView::create_framebuffers(unsigned int width, unsigned int height) {
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
     framebuf->attach_color(*screen_texture);
+    if (fuse_bright_pass) {
+      framebuf->attach_color(*bright_texture);
+    }
     depth_renderbuf = std::make_unique<Renderbuffer>(width, height);
     framebuf->attach_depth(*depth_renderbuf);
     framebuf->finalize();
   }
 
-  {
-    bloom_pingpong_framebufs.clear();
-    bloom_pingpong_textures.clear();
-
-    for (int i = 0; i < 2; ++i) {
-      bloom_pingpong_textures.emplace_back(width, height, GL_RGB16F, GL_FLOAT);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-      Framebuffer buf;
-      buf.attach_color(bloom_pingpong_textures.back());
-      buf.finalize();
-      bloom_pingpong_framebufs.push_back(std::move(buf));
-    }
-  }
-
-  {
-    shadow_framebuf = std::make_unique<Framebuffer>();
-    shadow_texture = std::make_unique<Texture>(shadow_map_size, shadow_map_size,
-                                               GL_DEPTH_COMPONENT24, GL_FLOAT,
-                                               GL_DEPTH_COMPONENT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE,
-                    GL_COMPARE_REF_TO_TEXTURE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-    float borderColor[] = {1.0f, 1.0f, 1.0f, 1.0f};
-    glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-    shadow_framebuf->attach_depth(*shadow_texture);
-    shadow_framebuf->finalize();
-  }
+  shadow_map = std::make_unique<ShadowMap>(shadow_map_size, shadow_cascades,
+                                           shadow_distance);
 }
 
 // --- OpenGL drawing
@@ -212,33 +306,31 @@ void MainView::create_framebuffers(unsigned int width, unsigned int height) {
 void MainView::draw_scene() {
   scene.update();
 
-  glViewport(0, 0, shadow_map_size, shadow_map_size);
-  shadow_framebuf->bind();
-  glClear(GL_DEPTH_BUFFER_BIT);
-
-  QVector3D light_pos(scene.light.pos.x, scene.light.pos.y, scene.light.pos.z);
-  QMatrix4x4 light_proj, light_view;
-  light_proj.ortho(-5.0f, 5.0f, -5.0f, 5.0f, 0.1f, 100.0f);
-
-  light_view.lookAt(light_pos, QVector3D(0.0f, 0.0f, 0.0f),
-                    QVector3D(0.0f, 1.0f, 0.0f));
-
-  shadow_pass_shader->draw(scene, light_view, light_proj);
+  QMatrix4x4 view = view_transform();
+  shadow_map->draw(scene, *shadow_pass_shader, view, proj_transform);
 
-  glViewport(0, 0, screen_width, screen_height);
+  auto& state = GLState::current();
+  state.viewport(0, 0, screen_width, screen_height);
   framebuf->bind();
 
-  glEnable(GL_DEPTH_TEST);
+  state.set_enabled(GL_DEPTH_TEST, true);
   glClearColor(sky_color.x(), sky_color.y(), sky_color.z(), 0.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  if (fuse_bright_pass) {
+    // The sky is as bright as the bright pass would find it
+    float brightness = QVector3D::dotProduct(
+        sky_color, QVector3D(0.2126f, 0.7152f, 0.0722f));
+    auto bright_sky =
+        brightness > bloom_settings.threshold ? sky_color : QVector3D();
+    float clear_color[] = {bright_sky.x(), bright_sky.y(), bright_sky.z(),
+                           1.0f};
+    glClearBufferfv(GL_COLOR, 1, clear_color);
+  }
 
-  QMatrix4x4 view = view_transform();
-
-  glActiveTexture(GL_TEXTURE1);
-  shadow_texture->bind();
+  state.active_texture(1);
+  shadow_map->bind();
 
-  phong_shader->uniform("light_view", light_view);
-  phong_shader->uniform("light_projection", light_proj);
+  shadow_map->bind_uniforms(*uniforms);
   phong_shader->draw(scene, view, proj_transform);
 }
 
@@ -252,6 +344,7 @@ void MainView::draw_scene() {
 void MainView::draw_screen_quad(Texture& source, Framebuffer& destination,
                                 ShaderInstance& shader) {
   destination.bind();
+  GLState::current().active_texture(0);
   source.bind();
 
   glClear(GL_COLOR_BUFFER_BIT);
@@ -259,35 +352,74 @@ void MainView::draw_screen_quad(Texture& source, Framebuffer& destination,
 }
 
 void MainView::paintGL() {
-  int oldFbo;
-  glGetIntegerv(GL_FRAMEBUFFER_BINDING, &oldFbo);
+  // Qt draws with the context between frames
+  auto& state = GLState::current();
+  state.invalidate();
+
+  auto finished = assets.finish_ready(asset_upload_budget_ns);
+  auto streamed = textures.stream_uploads(texture_upload_budget);
+  if ((finished > 0 || streamed > 0) && assets.pending() == 0 &&
+      !textures.is_uploading()) {
+    textures.log_stats();
+  }
+  // Loads run concurrently, so the peak is only telling once all are done
+  if (finished > 0 && assets.pending() == 0) {
+    auto peak = peak_resident_bytes();
+    if (peak >= 0) {
+      qDebug() << ":: Peak RSS after loading all assets:"
+               << peak / (1024.0 * 1024.0) << "MB";
+    }
+  }
 
+  uniforms->begin_frame();
   draw_scene();
+  uniforms->end_frame();
+  texture_streaming.update();
 
-  glDisable(GL_DEPTH_TEST);
-
-  // Extract bright parts from image into first bloom buffer
-  draw_screen_quad(*screen_texture, bloom_pingpong_framebufs.front(),
-                   *high_pass_shader);
+  state.set_enabled(GL_DEPTH_TEST, false);
 
-  for (int i = 0; i < 5; i++) {
-    draw_screen_quad(bloom_pingpong_textures.front(),
-                     bloom_pingpong_framebufs.back(), *vert_blur_shader);
-
-    draw_screen_quad(bloom_pingpong_textures.back(),
-                     bloom_pingpong_framebufs.front(), *horiz_blur_shader);
+  // Extract bright parts from image, unless the phong pass did, and blur them
+  if (!fuse_bright_pass) {
+    draw_screen_quad(*screen_texture, *bright_framebuf, *high_pass_shader);
   }
+  auto& bloom_texture = bloom->apply(*bright_texture, *screen_quad);
 
-  glBindFramebuffer(GL_FRAMEBUFFER, oldFbo);
-  glEnable(GL_DEPTH_TEST);
+  // The widget's framebuffer, bound by Qt before each frame
+  state.viewport(0, 0, screen_width, screen_height);
+  state.bind_framebuffer(GL_FRAMEBUFFER, defaultFramebufferObject());
+  state.set_enabled(GL_DEPTH_TEST, true);
 
   // Combine bloom with scene
-  glActiveTexture(GL_TEXTURE0);
+  state.active_texture(0);
   screen_texture->bind();
-  glActiveTexture(GL_TEXTURE1);
-  bloom_pingpong_textures.front().bind();
+  state.active_texture(1);
+  bloom_texture.bind();
   glClear(GL_COLOR_BUFFER_BIT);
   screen_shader->draw(*screen_quad);
+
+  render_stats = shadow_pass_shader->take_render_stats();
+  render_stats += phong_shader->take_render_stats();
+  render_stats += high_pass_shader->take_render_stats();
+  render_stats += bloom->take_render_stats();
+  render_stats += screen_shader->take_render_stats();
+  shadow_culling = shadow_pass_shader->take_cull_stats();
+  camera_culling = phong_shader->take_cull_stats();
+  if (frame_count++ % stats_log_interval == 0) {
+    log_frame_stats();
+  }
+  state.validate();
+}
+
+void MainView::log_frame_stats() const {
+  qDebug() << ":: Frame:" << render_stats.draws << "draws of"
+           << render_stats.instances << "instances,"
+           << render_stats.state_changes << "state changes and"
+           << render_stats.state_changes_avoided << "avoided,"
+           << render_stats.uniform_calls << "uniform calls and"
+           << render_stats.uniform_calls_avoided << "avoided";
+  qDebug() << ":: Meshes drawn:" << camera_culling.drawn << "by the camera and"
+           << camera_culling.culled << "culled," << shadow_culling.drawn
+           << "into shadows and" << shadow_culling.culled << "culled";
 }
 
 /**
@@ -303,6 +435,8 @@ void MainView::resizeGL(int newWidth, int newHeight) {
   screen_height = newHeight;
 
   create_framebuffers(newWidth, newHeight);
+  phong_shader->set_lod_settings(
+      {static_cast<float>(newHeight), camera_lod_pixel_error});
 
   // Update projection to fit the new aspect ratio
   float ratio = (float)newWidth / newHeight;
@@ -1,9 +1,14 @@
 #ifndef MAINVIEW_H
 #define MAINVIEW_H
 
+#include "asset_loader.h"
+#include "bloom.h"
 #include "framebuffer.h"
 #include "scene.h"
+#include "shadow_map.h"
 #include "shader.h"
+#include "texture_cache.h"
+#include "texture_streamer.h"
 
 #include <QColor>
 #include <QKeyEvent>
@@ -15,6 +20,7 @@
 #include <QTimer>
 #include <QVector3D>
 #include <memory>
+#include <vector>
 
 class MainView : public QOpenGLWidget, protected QOpenGLFunctions_3_3_Core {
   Q_OBJECT
@@ -45,8 +51,23 @@ private slots:
   void onMessageLogged(QOpenGLDebugMessage Message);
 
 private:
+  // Source images and lighting coefficients of a material to be loaded
+  struct MaterialSource {
+    QString diffuse, wave_mask;
+    float ka, kd, ks, exp;
+    bool is_water;
+    bool sways;
+  };
+
   void createShaderPrograms();
   void createGeometry();
+  // Loads a mesh once for any number of instances, which share it and its
+  // material. Large meshes are split into chunks by chunks parts, which pick
+  // their levels of detail and are culled on their own.
+  void load_instances(const QString& mesh_path,
+                      const MaterialSource& material,
+                      const std::vector<Transform>& transforms,
+                      unsigned chunks = 1);
 
   void create_framebuffers(unsigned width, unsigned height);
 
@@ -55,21 +76,38 @@ private:
                         ShaderInstance& shader);
 
   QMatrix4x4 view_transform() const;
+  // Logs the stats of the last frame
+  void log_frame_stats() const;
 
+  std::unique_ptr<UniformRing> uniforms;
   std::unique_ptr<ShaderInstance> phong_shader, shadow_pass_shader,
-      high_pass_shader, screen_shader, vert_blur_shader, horiz_blur_shader;
+      high_pass_shader, screen_shader;
   Scene scene;
+  // Instances in the scene by call of load_instances, none until loaded
+  std::vector<std::size_t> loaded_instances;
+  TextureCache textures;
+  // Declared after the cache, which its workers use
+  AssetLoader assets;
+  TextureStreamer texture_streaming;
 
   std::unique_ptr<Mesh> screen_quad;
   std::unique_ptr<Framebuffer> framebuf;
   std::unique_ptr<Renderbuffer> depth_renderbuf;
   std::unique_ptr<Texture> screen_texture;
 
-  std::unique_ptr<Framebuffer> shadow_framebuf;
-  std::unique_ptr<Texture> shadow_texture;
+  std::unique_ptr<ShadowMap> shadow_map;
+
+  // Bright parts of the frame, blurred by the bloom
+  std::unique_ptr<Framebuffer> bright_framebuf;
+  std::unique_ptr<Texture> bright_texture;
+  std::unique_ptr<Bloom> bloom;
 
-  std::vector<Framebuffer> bloom_pingpong_framebufs;
-  std::vector<Texture> bloom_pingpong_textures;
+  // State changes and uniform calls of all shaders in the last frame
+  RenderStats render_stats;
+  // Meshes drawn and culled in the last frame, by all cascades of the shadow
+  // map and by the camera
+  CullStats shadow_culling, camera_culling;
+  unsigned frame_count = 0;
 
   QMatrix4x4 proj_transform;
   QMatrix4x4 rotation, scaling;
@@ -0,0 +1,38 @@
+#include <QResource>
+
+#include "mapped_file.h"
+
+namespace {
+bool is_compressed_resource(const QString& filename) {
+  if (!filename.startsWith(":")) {
+    return false;
+  }
+  QResource resource(filename);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 13, 0)
+  return resource.compressionAlgorithm() != QResource::NoCompression;
+#else
+  return resource.isCompressed();
+#endif
+}
+} // namespace
+
+MappedFile::MappedFile(QFile& file) : file(file) {
+  if (file.size() > 0 && !is_compressed_resource(file.fileName())) {
+    mapped = file.map(0, file.size());
+  }
+
+  if (mapped) {
+    begin = reinterpret_cast<const char*>(mapped);
+    length = file.size();
+  } else {
+    buffer = file.readAll();
+    begin = buffer.constData();
+    length = buffer.size();
+  }
+}
+
+MappedFile::~MappedFile() {
+  if (mapped) {
+    file.unmap(mapped);
+  }
+}
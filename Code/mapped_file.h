@@ -0,0 +1,31 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <QByteArray>
+#include <QFile>
+
+// Read-only view of the whole contents of a file. Regular files are
+// memory-mapped; compressed Qt resources, whose data is not stored verbatim,
+// are decompressed into a single buffer instead.
+class MappedFile {
+public:
+  // The file must be open for reading, and must outlive this object
+  explicit MappedFile(QFile& file);
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  const char* data() const { return begin; }
+  qint64 size() const { return length; }
+  bool is_mapped() const { return mapped != nullptr; }
+
+private:
+  QFile& file;
+  uchar* mapped = nullptr;
+  QByteArray buffer;
+  const char* begin = nullptr;
+  qint64 length = 0;
+};
+
+#endif // MAPPED_FILE_H
@@ -1,19 +1,30 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
-#include "texture.h"
+#include <memory>
+
+#include "texture_array.h"
 #include "vertex.h"
 
+// Textures are shared with every other material using the same image, and
+// are layers of arrays that other materials' textures may be in as well
 struct Material {
-  Material(Texture diffuse, float ka, float kd, float ks, float exp,
-           Texture wave_mask)
+  Material(std::shared_ptr<TextureLayer> diffuse, float ka, float kd, float ks,
+           float exp, std::shared_ptr<TextureLayer> wave_mask)
       : diffuse(std::move(diffuse)), ka(ka), kd(kd), ks(ks), exp(exp),
         wave_mask(std::move(wave_mask)) {}
 
-  Texture diffuse;
+  std::shared_ptr<TextureLayer> diffuse;
   float ka, kd, ks, exp;
-  Texture wave_mask;
+  std::shared_ptr<TextureLayer> wave_mask;
   bool is_water = false;
+  // Whether the wave mask lets the vertex shaders sway the mesh
+  bool sways = false;
+
+  // Whether the textures have finished streaming in
+  bool is_resident() const {
+    return diffuse->is_resident() && wave_mask->is_resident();
+  }
 };
 
 #endif // MATERIAL_H
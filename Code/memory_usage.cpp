@@ -0,0 +1,71 @@
+#include <QFile>
+
+#include "memory_usage.h"
+
+#if defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+namespace {
+#if defined(Q_OS_LINUX)
+// Reads a "Name:   1234 kB" line of /proc/self/status
+qint64 read_status_kilobytes(const char* name) {
+  QFile status("/proc/self/status");
+  if (!status.open(QIODevice::ReadOnly)) {
+    return -1;
+  }
+  QByteArray prefix(name);
+  prefix += ':';
+  for (;;) {
+    auto line = status.readLine();
+    if (line.isEmpty()) {
+      return -1;
+    }
+    if (line.startsWith(prefix)) {
+      auto fields = line.mid(prefix.size()).simplified().split(' ');
+      bool ok = false;
+      auto kilobytes = fields.value(0).toLongLong(&ok);
+      return ok ? kilobytes : -1;
+    }
+  }
+}
+#endif
+} // namespace
+
+qint64 current_resident_bytes() {
+#if defined(Q_OS_LINUX)
+  auto kilobytes = read_status_kilobytes("VmRSS");
+  return kilobytes < 0 ? -1 : kilobytes * 1024;
+#else
+  return -1;
+#endif
+}
+
+qint64 peak_resident_bytes() {
+#if defined(Q_OS_LINUX)
+  auto kilobytes = read_status_kilobytes("VmHWM");
+  return kilobytes < 0 ? -1 : kilobytes * 1024;
+#elif defined(Q_OS_UNIX)
+  rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return -1;
+  }
+#if defined(Q_OS_DARWIN)
+  return usage.ru_maxrss;
+#else
+  return qint64(usage.ru_maxrss) * 1024;
+#endif
+#else
+  return -1;
+#endif
+}
+
+bool reset_peak_resident_bytes() {
+#if defined(Q_OS_LINUX)
+  // Writing 5 resets VmHWM to the current resident set size
+  QFile clear_refs("/proc/self/clear_refs");
+  return clear_refs.open(QIODevice::WriteOnly) && clear_refs.write("5") == 1;
+#else
+  return false;
+#endif
+}
@@ -0,0 +1,18 @@
+#ifndef MEMORY_USAGE_H
+#define MEMORY_USAGE_H
+
+#include <QtGlobal>
+
+// Resident set size of the process in bytes, or -1 where unsupported
+qint64 current_resident_bytes();
+
+// Largest resident set size of the process so far in bytes, or -1 where
+// unsupported
+qint64 peak_resident_bytes();
+
+// Restarts tracking the peak from the current resident set size, so that the
+// peak of a single operation can be measured. Returns false where
+// unsupported, in which case the peak covers the whole process lifetime.
+bool reset_peak_resident_bytes();
+
+#endif // MEMORY_USAGE_H
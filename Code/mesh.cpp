@@ -1,24 +1,41 @@
+#include <QDebug>
+#include <QFile>
+
 #include <algorithm>
-#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <limits>
 
+#include "gl_state.h"
+#include "mapped_file.h"
 #include "material.h"
 #include "mesh.h"
-#include "model.h"
+#include "mesh_data.h"
 
 Mesh::Mesh(const std::vector<Vertex>& vertices,
-           const std::vector<unsigned int>& indices) {
+           const std::vector<unsigned int>& indices, VertexFormat format)
+    : Mesh(vertices.data(), vertices.size(), indices.data(), indices.size(),
+           format) {}
+
+Mesh::Mesh(const Vertex* vertices, std::size_t vertex_count,
+           const unsigned int* indices, std::size_t index_count,
+           VertexFormat format)
+    : format(format) {
   // Create a mesh from raw arrays of vertices and indices
   initializeOpenGLFunctions();
 
   create_buffers();
-  fill_buffers(vertices, indices);
+  fill_buffers(vertices, vertex_count, indices, index_count);
   define_data_layout();
 
   // Unbind the vertex array when done
-  glBindVertexArray(0);
+  GLState::current().bind_vertex_array(0);
 }
 
 Mesh::~Mesh() {
+  if (vao) {
+    GLState::current().deleted_vertex_array(vao);
+  }
   glDeleteVertexArrays(1, &vao);
   glDeleteBuffers(1, &vbo);
   glDeleteBuffers(1, &ebo);
@@ -28,12 +45,53 @@ void Mesh::swap(Mesh&& other) {
   std::swap(vao, other.vao);
   std::swap(vbo, other.vbo);
   std::swap(ebo, other.ebo);
+  std::swap(instanced, other.instanced);
   std::swap(index_count, other.index_count);
+  std::swap(index_type, other.index_type);
+  std::swap(format, other.format);
+  std::swap(decode, other.decode);
+  std::swap(lods, other.lods);
+  std::swap(box, other.box);
+  std::swap(sphere, other.sphere);
+  std::swap(texcoord_density, other.texcoord_density);
+  std::swap(texcoord_area, other.texcoord_area);
+}
+
+void Mesh::draw(int lod) {
+  const auto& range = lods[lod];
+  GLState::current().bind_vertex_array(vao);
+  glDrawElements(GL_TRIANGLES, range.index_count, index_type,
+                 first_index(range));
+}
+
+void Mesh::draw_instanced(int lod, GLsizei instances, GLuint buffer,
+                          std::size_t offset) {
+  const auto& range = lods[lod];
+  GLState::current().bind_vertex_array(vao);
+  // The attribute pointers keep the buffer bound when they were set
+  glBindBuffer(GL_ARRAY_BUFFER, buffer);
+  define_instance_layout(offset);
+  glDrawElementsInstanced(GL_TRIANGLES, range.index_count, index_type,
+                          first_index(range), instances);
+}
+
+int Mesh::select_lod(float max_error) const {
+  for (int lod = lod_count() - 1; lod > 0; --lod) {
+    if (lods[lod].error <= max_error) {
+      return lod;
+    }
+  }
+  return 0;
 }
 
-void Mesh::draw() {
-  glBindVertexArray(vao);
-  glDrawElements(GL_TRIANGLES, index_count, GL_UNSIGNED_INT, 0);
+float Mesh::uv_spacing(int lod) const {
+  // Every level covers about the same area, a square of two triangles of it
+  // has the side sqrt(2 * area / triangles)
+  auto triangles = lods[lod].index_count / 3;
+  if (triangles == 0) {
+    return 0.0f;
+  }
+  return std::sqrt(texcoord_area / lod_count() / triangles);
 }
 
 void Mesh::create_buffers() {
@@ -42,54 +100,176 @@ void Mesh::create_buffers() {
   glGenBuffers(1, &ebo);
 }
 
-void Mesh::fill_buffers(const std::vector<Vertex>& vertices,
-                        const std::vector<unsigned int>& indices) {
-  glBindVertexArray(vao);
+void Mesh::fill_buffers(const Vertex* vertices, std::size_t vertex_count,
+                        const unsigned int* indices, std::size_t index_count) {
+  GLState::current().bind_vertex_array(vao);
   glBindBuffer(GL_ARRAY_BUFFER, vbo);
   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
 
-  glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex),
-               vertices.data(), GL_STATIC_DRAW);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int),
-               indices.data(), GL_STATIC_DRAW);
+  if (format == VertexFormat::Float) {
+    decode = PositionDecode();
+    glBufferData(GL_ARRAY_BUFFER, vertex_count * sizeof(Vertex), vertices,
+                 GL_STATIC_DRAW);
+  } else {
+    auto packed = pack_vertices(vertices, vertex_count, format, decode);
+    glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex),
+                 packed.data(), GL_STATIC_DRAW);
+  }
+
+  // Halve the index buffer if all vertices fit in 16 bits
+  if (vertex_count <= std::numeric_limits<std::uint16_t>::max() + 1u) {
+    std::vector<std::uint16_t> short_indices(indices, indices + index_count);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                 index_count * sizeof(std::uint16_t), short_indices.data(),
+                 GL_STATIC_DRAW);
+    index_type = GL_UNSIGNED_SHORT;
+  } else {
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, index_count * sizeof(unsigned int),
+                 indices, GL_STATIC_DRAW);
+    index_type = GL_UNSIGNED_INT;
+  }
+
+  this->index_count = index_count;
+  lods.assign(1, MeshLod{0, static_cast<quint32>(index_count), 0.0f});
+
+  constexpr auto inf = std::numeric_limits<float>::infinity();
+  box = BoundingBox{{inf, inf, inf}, {-inf, -inf, -inf}};
+  for (std::size_t i = 0; i < vertex_count; ++i) {
+    const auto& pos = vertices[i].pos;
+    QVector3D point(pos.x, pos.y, pos.z);
+    for (int axis = 0; axis < 3; ++axis) {
+      box.min[axis] = std::min(box.min[axis], point[axis]);
+      box.max[axis] = std::max(box.max[axis], point[axis]);
+    }
+  }
+
+  if (vertex_count == 0) {
+    box = BoundingBox();
+  }
+  sphere.center = box.center();
+  float max_distance_squared = 0.0f;
+  for (std::size_t i = 0; i < vertex_count; ++i) {
+    const auto& pos = vertices[i].pos;
+    max_distance_squared = std::max(
+        max_distance_squared,
+        (QVector3D(pos.x, pos.y, pos.z) - sphere.center).lengthSquared());
+  }
+  sphere.radius = std::sqrt(max_distance_squared);
 
-  index_count = indices.size();
+  // Ratio of the areas the triangles cover in texture and in mesh space
+  double uv_area = 0.0, area = 0.0;
+  for (std::size_t i = 0; i + 2 < index_count; i += 3) {
+    const auto& a = vertices[indices[i]];
+    const auto& b = vertices[indices[i + 1]];
+    const auto& c = vertices[indices[i + 2]];
+    uv_area += std::abs((b.coords.u - a.coords.u) * (c.coords.v - a.coords.v) -
+                        (c.coords.u - a.coords.u) * (b.coords.v - a.coords.v));
+    QVector3D ab(b.pos.x - a.pos.x, b.pos.y - a.pos.y, b.pos.z - a.pos.z);
+    QVector3D ac(c.pos.x - a.pos.x, c.pos.y - a.pos.y, c.pos.z - a.pos.z);
+    area += QVector3D::crossProduct(ab, ac).length();
+  }
+  texcoord_density = area > 0.0 ? std::sqrt(uv_area / area) : 0.0f;
+  texcoord_area = static_cast<float>(uv_area);
 }
 
 void Mesh::define_data_layout() {
   glEnableVertexAttribArray(0);
   glEnableVertexAttribArray(1);
   glEnableVertexAttribArray(2);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                        reinterpret_cast<GLvoid*>(offsetof(Vertex, pos)));
-  glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                        reinterpret_cast<GLvoid*>(offsetof(Vertex, normal)));
-  glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
-                        reinterpret_cast<GLvoid*>(offsetof(Vertex, coords)));
+
+  if (format == VertexFormat::Float) {
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                          reinterpret_cast<GLvoid*>(offsetof(Vertex, pos)));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                          reinterpret_cast<GLvoid*>(offsetof(Vertex, normal)));
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex),
+                          reinterpret_cast<GLvoid*>(offsetof(Vertex, coords)));
+    return;
+  }
+
+  glVertexAttribPointer(0, 3, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+                        reinterpret_cast<GLvoid*>(offsetof(PackedVertex, pos)));
+  if (format == VertexFormat::Octahedral) {
+    glVertexAttribPointer(
+        1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex),
+        reinterpret_cast<GLvoid*>(offsetof(PackedVertex, normal)));
+  } else {
+    glVertexAttribPointer(
+        1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex),
+        reinterpret_cast<GLvoid*>(offsetof(PackedVertex, normal)));
+  }
+  glVertexAttribPointer(
+      2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex),
+      reinterpret_cast<GLvoid*>(offsetof(PackedVertex, coords)));
 }
 
-Mesh Mesh::from_file(const QString& filename) {
-  std::vector<Vertex> vertices;
-  std::vector<unsigned int> indices;
-
-  auto model = Model(filename);
-  model.unitize();
-
-  auto qVerts = model.getVertices_indexed();
-  auto qNormals = model.getNormals_indexed();
-  auto qCoords = model.getTextureCoords_indexed();
-  assert((qVerts.size() == qNormals.size()) &&
-         (qVerts.size() == qCoords.size()));
-  for (int i = 0; i < qVerts.size(); ++i) {
-    // Read off position, normal and tex coords from model
-    Vector position(qVerts[i]);
-    Vector normal(qNormals[i]);
-    TexCoord coord(qCoords[i]);
-    vertices.push_back(Vertex{position, normal, coord});
-  }
-  auto qIndices = model.getIndices();
-  indices = std::vector<unsigned int>(qIndices.begin(), qIndices.end());
-  return Mesh(vertices, indices);
+void Mesh::define_instance_layout(std::size_t offset) {
+  // The model matrix takes locations 3 to 6, one per column, the normal
+  // matrix 7 to 9 and the seed 10
+  constexpr GLuint model_location = 3, normal_location = 7, seed_location = 10;
+  if (!instanced) {
+    for (GLuint location = model_location; location <= seed_location;
+         ++location) {
+      glEnableVertexAttribArray(location);
+      glVertexAttribDivisor(location, 1);
+    }
+    instanced = true;
+  }
+
+  constexpr auto stride = sizeof(InstanceAttributes);
+  for (GLuint column = 0; column < 4; ++column) {
+    auto column_offset = offset + offsetof(InstanceAttributes, model) +
+                         column * 4 * sizeof(float);
+    glVertexAttribPointer(model_location + column, 4, GL_FLOAT, GL_FALSE,
+                          stride, reinterpret_cast<GLvoid*>(column_offset));
+  }
+  for (GLuint column = 0; column < 3; ++column) {
+    auto column_offset = offset + offsetof(InstanceAttributes, normal_matrix) +
+                         column * 3 * sizeof(float);
+    glVertexAttribPointer(normal_location + column, 3, GL_FLOAT, GL_FALSE,
+                          stride, reinterpret_cast<GLvoid*>(column_offset));
+  }
+  glVertexAttribPointer(
+      seed_location, 1, GL_FLOAT, GL_FALSE, stride,
+      reinterpret_cast<GLvoid*>(offset + offsetof(InstanceAttributes, seed)));
+}
+
+const GLvoid* Mesh::first_index(const MeshLod& lod) const {
+  auto index_size =
+      index_type == GL_UNSIGNED_SHORT ? sizeof(std::uint16_t) : sizeof(GLuint);
+  return reinterpret_cast<const GLvoid*>(lod.first_index * index_size);
+}
+
+Mesh Mesh::from_file(const QString& filename, VertexFormat format) {
+  // Prefer a precompiled binary mesh, which is uploaded straight from the
+  // file contents without any parsing
+  auto binary_path = find_binary_mesh(filename);
+  if (!binary_path.isEmpty()) {
+    QFile file(binary_path);
+    if (file.open(QIODevice::ReadOnly)) {
+      MappedFile contents(file);
+      MeshFileView view;
+      if (read_mesh_file(contents.data(), contents.size(), view)) {
+        qDebug() << ":: Loading binary mesh:" << binary_path;
+        Mesh mesh(view.vertices, view.header->vertex_count, view.indices,
+                  view.header->index_count, format);
+        if (view.header->lod_count > 0) {
+          mesh.lods.assign(view.lods, view.lods + view.header->lod_count);
+        }
+        return mesh;
+      }
+    }
+  }
+
+  return from_data(load_obj(filename), format);
+}
+
+Mesh Mesh::from_data(const MeshData& data, VertexFormat format) {
+  Mesh mesh(data.vertices, data.indices, format);
+  if (!data.lods.empty()) {
+    mesh.lods = data.lods;
+  }
+  return mesh;
 }
 
 Mesh Mesh::screen_quad() {
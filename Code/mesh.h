@@ -8,14 +8,30 @@
 #include <vector>
 
 #include "animation.h"
+#include "frustum.h"
 #include "material.h"
+#include "mesh_data.h"
 #include "transform.h"
 #include "vertex.h"
+#include "vertex_format.h"
+
+// Attributes of one instance of a mesh, advanced once per instance when drawn
+// instanced. The matrices are column major, the normal matrix is 3x3.
+struct InstanceAttributes {
+  float model[16];
+  float normal_matrix[9];
+  // Varies the phase of the waves between instances, in periods
+  float seed;
+};
 
 class Mesh : protected QOpenGLFunctions_3_3_Core {
 public:
   Mesh(const std::vector<Vertex>& vertices,
-       const std::vector<unsigned int>& indices);
+       const std::vector<unsigned int>& indices,
+       VertexFormat format = VertexFormat::Float);
+  Mesh(const Vertex* vertices, std::size_t vertex_count,
+       const unsigned int* indices, std::size_t index_count,
+       VertexFormat format = VertexFormat::Float);
   ~Mesh();
 
   void swap(Mesh&& other);
@@ -32,32 +48,88 @@ public:
   Mesh(const Mesh&) = delete;
   Mesh& operator=(const Mesh&) = delete;
 
-  void draw();
+  // Draws a level of detail, level 0 is the full resolution mesh
+  void draw(int lod = 0);
+  // Draws a level of detail once for each InstanceAttributes in a buffer,
+  // starting at an offset
+  void draw_instanced(int lod, GLsizei instances, GLuint buffer,
+                      std::size_t offset);
+
+  int lod_count() const { return static_cast<int>(lods.size()); }
+  // Coarsest level whose error stays within max_error
+  int select_lod(float max_error) const;
+  // Distance between the surface of a level and the full resolution one, in
+  // mesh units
+  float lod_error(int lod) const { return lods[lod].error; }
+  // Typical distance between neighbouring vertices of a level in texture
+  // coordinates, as its triangles cover the same texture area
+  float uv_spacing(int lod) const;
+  // Local bounds of all vertices, the sphere is centered on the box
+  const BoundingBox& bounding_box() const { return box; }
+  const BoundingSphere& bounding_sphere() const { return sphere; }
+  // Texture coordinate units per mesh unit, averaged over the surface
+  float uv_density() const { return texcoord_density; }
 
-  static Mesh from_file(const QString& filename);
+  VertexFormat vertex_format() const { return format; }
+  // Shaders reconstruct positions of quantized formats with this
+  const PositionDecode& position_decode() const { return decode; }
+
+  // Loads a precompiled binary mesh if filename is one, or if one exists next
+  // to it, and parses filename as a Wavefront .obj file otherwise
+  static Mesh from_file(const QString& filename,
+                        VertexFormat format = VertexFormat::Float);
+  static Mesh from_data(const MeshData& data,
+                        VertexFormat format = VertexFormat::Float);
   static Mesh screen_quad();
 
 private:
   void create_buffers();
-  void fill_buffers(const std::vector<Vertex>& vertices,
-                    const std::vector<unsigned int>& indices);
+  void fill_buffers(const Vertex* vertices, std::size_t vertex_count,
+                    const unsigned int* indices, std::size_t index_count);
   void define_data_layout();
+  // Points the instance attributes at a buffer, which is bound as the array
+  // buffer
+  void define_instance_layout(std::size_t offset);
+  const GLvoid* first_index(const MeshLod& lod) const;
 
   GLuint vao = 0, vbo = 0, ebo = 0;
+  // Whether the vertex array has the instance attributes enabled
+  bool instanced = false;
   std::size_t index_count = 0;
+  // GL_UNSIGNED_SHORT whenever all vertices can be addressed with it
+  GLenum index_type = GL_UNSIGNED_INT;
+  VertexFormat format = VertexFormat::Float;
+  PositionDecode decode;
+  std::vector<MeshLod> lods;
+  BoundingBox box;
+  BoundingSphere sphere;
+  float texcoord_density = 0.0f;
+  // Twice the texture area the triangles of all levels cover together
+  float texcoord_area = 0.0f;
 };
 
+// A placement of a mesh, which any number of instances may share. Instances
+// sharing both their mesh and material are drawn together.
 struct MeshInstance {
-  MeshInstance(Mesh&& mesh, std::shared_ptr<Material> material,
+  MeshInstance(std::shared_ptr<Mesh> mesh, std::shared_ptr<Material> material,
                std::unique_ptr<Animation> anim = nullptr,
-               Transform transform = {})
+               Transform transform = {}, float seed = 0.0f)
       : mesh(std::move(mesh)), material(std::move(material)),
-        anim(std::move(anim)), transform(std::move(transform)) {}
+        anim(std::move(anim)), transform(std::move(transform)), seed(seed) {}
+
+  // Whether the mesh moves from frame to frame, by its animation or by the
+  // vertex shaders
+  bool is_dynamic() const {
+    return anim || material->is_water || material->sways;
+  }
 
-  Mesh mesh;
+  std::shared_ptr<Mesh> mesh;
   std::shared_ptr<Material> material;
   std::unique_ptr<Animation> anim;
   Transform transform;
+  // Offsets the phase of the mesh's waves in periods, so that copies do not
+  // sway alike
+  float seed;
 };
 
 #endif // MESH_HPP
@@ -0,0 +1,212 @@
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "mapped_file.h"
+#include "mesh_data.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "model.h"
+
+static_assert(sizeof(MeshFileHeader) % alignof(Vertex) == 0,
+              "Vertex data following the header must stay aligned");
+
+MeshData load_obj(const QString& filename, int parse_threads) {
+  // Model welds straight into the interleaved vertex buffer, which is moved
+  // out as is
+  ModelOptions options;
+  options.threads = parse_threads;
+  auto model = Model(filename, options);
+  model.unitize();
+  auto mesh = model.takeMeshData();
+
+  optimize_mesh(mesh);
+  generate_lods(mesh);
+
+  // Loads run concurrently, so the process's memory is not this mesh's
+  auto buffer_bytes = mesh.vertices.size() * sizeof(Vertex) +
+                      mesh.indices.size() * sizeof(unsigned int);
+  qDebug() << ":: Vertex and index buffers of" << filename << ":"
+           << buffer_bytes / (1024.0 * 1024.0) << "MB";
+  return mesh;
+}
+
+MeshData load_mesh_data(const QString& filename, int parse_threads) {
+  auto binary_path = find_binary_mesh(filename);
+  if (binary_path.isEmpty()) {
+    return load_obj(filename, parse_threads);
+  }
+
+  QFile file(binary_path);
+  MeshData mesh;
+  if (file.open(QIODevice::ReadOnly)) {
+    MappedFile contents(file);
+    MeshFileView view;
+    if (read_mesh_file(contents.data(), contents.size(), view)) {
+      qDebug() << ":: Loading binary mesh:" << binary_path;
+      mesh.vertices.assign(view.vertices,
+                           view.vertices + view.header->vertex_count);
+      mesh.indices.assign(view.indices,
+                          view.indices + view.header->index_count);
+      mesh.lods.assign(view.lods, view.lods + view.header->lod_count);
+    }
+  }
+  return mesh;
+}
+
+std::vector<MeshData> split_mesh(const MeshData& mesh, unsigned chunks) {
+  std::size_t index_count =
+      mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].index_count;
+  constexpr auto inf = std::numeric_limits<float>::infinity();
+  float min_x = inf, min_z = inf, max_x = -inf, max_z = -inf;
+  for (const auto& vertex : mesh.vertices) {
+    min_x = std::min(min_x, vertex.pos.x);
+    max_x = std::max(max_x, vertex.pos.x);
+    min_z = std::min(min_z, vertex.pos.z);
+    max_z = std::max(max_z, vertex.pos.z);
+  }
+  auto cell = [chunks](float value, float min, float max) {
+    if (max <= min) {
+      return 0u;
+    }
+    auto index = static_cast<unsigned>((value - min) / (max - min) * chunks);
+    return std::min(index, chunks - 1);
+  };
+
+  std::vector<MeshData> parts(chunks * chunks);
+  for (std::size_t i = 0; i + 2 < index_count; i += 3) {
+    float x = 0.0f, z = 0.0f;
+    for (int k = 0; k < 3; ++k) {
+      x += mesh.vertices[mesh.indices[i + k]].pos.x / 3.0f;
+      z += mesh.vertices[mesh.indices[i + k]].pos.z / 3.0f;
+    }
+    auto& part =
+        parts[cell(z, min_z, max_z) * chunks + cell(x, min_x, max_x)];
+    part.indices.insert(part.indices.end(), mesh.indices.begin() + i,
+                        mesh.indices.begin() + i + 3);
+  }
+
+  parts.erase(std::remove_if(parts.begin(), parts.end(),
+                             [](const MeshData& part) {
+                               return part.indices.empty();
+                             }),
+              parts.end());
+  for (auto& part : parts) {
+    // Keeps the order of the triangles, which stays cache friendly, and only
+    // the vertices they use
+    part.vertices = mesh.vertices;
+    optimize_vertex_fetch(part.vertices, part.indices);
+    generate_lods(part);
+  }
+  return parts;
+}
+
+bool is_mesh_file(const char* data, qint64 size) {
+  return size >= static_cast<qint64>(sizeof(mesh_file_magic)) &&
+         std::memcmp(data, mesh_file_magic, sizeof(mesh_file_magic)) == 0;
+}
+
+bool read_mesh_file(const char* data, qint64 size, MeshFileView& view) {
+  if (!is_mesh_file(data, size) ||
+      size < static_cast<qint64>(sizeof(MeshFileHeader))) {
+    qDebug() << "Not a binary mesh file";
+    return false;
+  }
+
+  auto header = reinterpret_cast<const MeshFileHeader*>(data);
+  if (header->version != mesh_file_version) {
+    qDebug() << "Unsupported binary mesh version:" << header->version;
+    return false;
+  }
+  if (header->vertex_size != sizeof(Vertex)) {
+    qDebug() << "Binary mesh vertex size mismatch:" << header->vertex_size;
+    return false;
+  }
+
+  qint64 expected_size = sizeof(MeshFileHeader) +
+                         qint64(header->vertex_count) * sizeof(Vertex) +
+                         qint64(header->index_count) * sizeof(unsigned int) +
+                         qint64(header->lod_count) * sizeof(MeshLod);
+  if (size < expected_size) {
+    qDebug() << "Truncated binary mesh file";
+    return false;
+  }
+
+  view.header = header;
+  view.vertices = reinterpret_cast<const Vertex*>(data + sizeof(MeshFileHeader));
+  view.indices =
+      reinterpret_cast<const unsigned int*>(view.vertices + header->vertex_count);
+  view.lods =
+      reinterpret_cast<const MeshLod*>(view.indices + header->index_count);
+  for (quint32 i = 0; i < header->lod_count; ++i) {
+    const auto& lod = view.lods[i];
+    if (quint64(lod.first_index) + lod.index_count > header->index_count) {
+      qDebug() << "Binary mesh LOD" << i << "is out of range";
+      return false;
+    }
+  }
+  return true;
+}
+
+bool write_mesh_file(const QString& filename, const MeshData& mesh) {
+  MeshFileHeader header;
+  std::memcpy(header.magic, mesh_file_magic, sizeof(mesh_file_magic));
+  header.version = mesh_file_version;
+  header.vertex_size = sizeof(Vertex);
+  header.vertex_count = mesh.vertices.size();
+  header.index_count = mesh.indices.size();
+  header.lod_count = mesh.lods.size();
+
+  constexpr auto inf = std::numeric_limits<float>::infinity();
+  header.bounds_min = Vector(inf, inf, inf);
+  header.bounds_max = Vector(-inf, -inf, -inf);
+  for (const auto& vertex : mesh.vertices) {
+    header.bounds_min.x = std::min(header.bounds_min.x, vertex.pos.x);
+    header.bounds_min.y = std::min(header.bounds_min.y, vertex.pos.y);
+    header.bounds_min.z = std::min(header.bounds_min.z, vertex.pos.z);
+    header.bounds_max.x = std::max(header.bounds_max.x, vertex.pos.x);
+    header.bounds_max.y = std::max(header.bounds_max.y, vertex.pos.y);
+    header.bounds_max.z = std::max(header.bounds_max.z, vertex.pos.z);
+  }
+
+  QFile file(filename);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qDebug() << "Error opening" << filename << "for writing:"
+             << file.errorString();
+    return false;
+  }
+  auto vertex_bytes = qint64(mesh.vertices.size() * sizeof(Vertex));
+  auto index_bytes = qint64(mesh.indices.size() * sizeof(unsigned int));
+  auto lod_bytes = qint64(mesh.lods.size() * sizeof(MeshLod));
+  return file.write(reinterpret_cast<const char*>(&header), sizeof(header)) ==
+             sizeof(header) &&
+         file.write(reinterpret_cast<const char*>(mesh.vertices.data()),
+                    vertex_bytes) == vertex_bytes &&
+         file.write(reinterpret_cast<const char*>(mesh.indices.data()),
+                    index_bytes) == index_bytes &&
+         file.write(reinterpret_cast<const char*>(mesh.lods.data()),
+                    lod_bytes) == lod_bytes;
+}
+
+QString binary_mesh_path(const QString& obj_filename) {
+  QFileInfo info(obj_filename);
+  return info.path() + "/" + info.completeBaseName() + ".mesh";
+}
+
+QString find_binary_mesh(const QString& filename) {
+  for (const auto& path : {filename, binary_mesh_path(filename)}) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+      continue;
+    }
+    auto magic = file.peek(sizeof(mesh_file_magic));
+    if (is_mesh_file(magic.constData(), magic.size())) {
+      return path;
+    }
+  }
+  return QString();
+}
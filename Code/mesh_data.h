@@ -0,0 +1,85 @@
+#ifndef MESH_DATA_H
+#define MESH_DATA_H
+
+#include <QString>
+#include <QtGlobal>
+
+#include <vector>
+
+#include "vertex.h"
+
+// A level of detail of a mesh, as a range of its index buffer
+struct MeshLod {
+  quint32 first_index;
+  quint32 index_count;
+  // Estimated distance between this level's surface and the full resolution
+  // one, in mesh units, as reported by simplify_mesh
+  float error;
+};
+
+// CPU-side geometry of a mesh, laid out exactly as Mesh uploads it
+struct MeshData {
+  std::vector<Vertex> vertices;
+  std::vector<unsigned int> indices;
+  // Levels of detail from fine to coarse, sharing the vertices. Empty means
+  // that all indices form a single level.
+  std::vector<MeshLod> lods;
+};
+
+// Parses, welds and unitizes a Wavefront .obj file, optimizes the order of
+// its triangles and vertices for the GPU and generates its levels of detail.
+// The file is parsed on parse_threads threads, 0 picks one per core.
+MeshData load_obj(const QString& filename, int parse_threads = 0);
+
+// Reads the precompiled binary mesh for filename if there is one, and parses
+// filename as a Wavefront .obj file otherwise, see load_obj
+MeshData load_mesh_data(const QString& filename, int parse_threads = 0);
+
+// Splits the full resolution level of a mesh into chunks by chunks parts on a
+// grid over its x-z bounds, by the centers of the triangles, and generates the
+// levels of detail of every part. Borders between the parts are never
+// simplified, so the parts' levels meet without cracks.
+std::vector<MeshData> split_mesh(const MeshData& mesh, unsigned chunks);
+
+// Binary mesh files start with this header, followed by the vertex buffer,
+// the index buffer and the LOD table. All values are stored in native
+// (little-endian) byte order.
+struct MeshFileHeader {
+  char magic[4];
+  quint32 version;
+  // Size of a single vertex, guards against changes to the Vertex layout
+  quint32 vertex_size;
+  quint32 vertex_count;
+  quint32 index_count;
+  quint32 lod_count;
+  Vector bounds_min;
+  Vector bounds_max;
+};
+
+constexpr char mesh_file_magic[4] = {'I', 'M', 'S', 'H'};
+constexpr quint32 mesh_file_version = 2;
+
+// Pointers into the contents of a binary mesh file
+struct MeshFileView {
+  const MeshFileHeader* header = nullptr;
+  const Vertex* vertices = nullptr;
+  const unsigned int* indices = nullptr;
+  const MeshLod* lods = nullptr;
+};
+
+// Whether the given bytes start like a binary mesh file
+bool is_mesh_file(const char* data, qint64 size);
+
+// Validates the header and fills in the view, without copying any data
+bool read_mesh_file(const char* data, qint64 size, MeshFileView& view);
+
+bool write_mesh_file(const QString& filename, const MeshData& mesh);
+
+// Path of the precompiled binary mesh next to the given .obj file
+QString binary_mesh_path(const QString& obj_filename);
+
+// Returns filename if it is a binary mesh file, else the binary mesh next to
+// it if that exists, else an empty string
+QString find_binary_mesh(const QString& filename);
+
+#endif // MESH_DATA_H
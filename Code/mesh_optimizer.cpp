@@ -0,0 +1,347 @@
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include "mesh_optimizer.h"
+
+namespace {
+constexpr unsigned no_vertex = std::numeric_limits<unsigned>::max();
+
+// Size of the LRU cache modelled by the Forsyth optimizer
+constexpr int forsyth_cache_size = 32;
+
+float forsyth_vertex_score(int cache_position, unsigned remaining_triangles) {
+  if (remaining_triangles == 0) {
+    // No triangle left to draw, the vertex is irrelevant
+    return -1.0f;
+  }
+
+  float score = 0.0f;
+  if (cache_position >= 0) {
+    if (cache_position < 3) {
+      // Used by the last triangle, deliberately lower than the next entries
+      // to avoid strip-like orders
+      score = 0.75f;
+    } else {
+      float scale = 1.0f / (forsyth_cache_size - 3);
+      score = std::pow(1.0f - (cache_position - 3) * scale, 1.5f);
+    }
+  }
+
+  // Prefer vertices with few triangles left, so they do not end up stranded
+  return score + 2.0f / std::sqrt(static_cast<float>(remaining_triangles));
+}
+
+// Simulates a FIFO cache through per-vertex timestamps: a vertex is a hit if
+// it was transformed less than cache_size misses ago
+class FifoCache {
+public:
+  FifoCache(std::size_t vertex_count, unsigned cache_size)
+      : timestamps(vertex_count, 0), cache_size(cache_size),
+        time(cache_size + 1) {}
+
+  // Returns the number of misses for the triangle
+  unsigned add_triangle(const unsigned int* triangle) {
+    unsigned misses = 0;
+    for (int k = 0; k < 3; ++k) {
+      auto vertex = triangle[k];
+      if (time - timestamps[vertex] > cache_size) {
+        timestamps[vertex] = time++;
+        ++misses;
+      }
+    }
+    return misses;
+  }
+
+  void flush() { time += cache_size + 1; }
+
+private:
+  std::vector<unsigned> timestamps;
+  unsigned cache_size;
+  unsigned time;
+};
+
+Vector operator+(const Vector& a, const Vector& b) {
+  return Vector(a.x + b.x, a.y + b.y, a.z + b.z);
+}
+
+Vector operator-(const Vector& a, const Vector& b) {
+  return Vector(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+Vector operator*(const Vector& a, float s) {
+  return Vector(a.x * s, a.y * s, a.z * s);
+}
+
+Vector cross(const Vector& a, const Vector& b) {
+  return Vector(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+                a.x * b.y - a.y * b.x);
+}
+
+float dot(const Vector& a, const Vector& b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+} // namespace
+
+VertexCacheStats analyze_vertex_cache(const std::vector<unsigned int>& indices,
+                                      std::size_t vertex_count,
+                                      unsigned cache_size) {
+  VertexCacheStats stats;
+  if (indices.empty()) {
+    return stats;
+  }
+
+  FifoCache cache(vertex_count, cache_size);
+  std::vector<bool> referenced(vertex_count, false);
+  std::size_t misses = 0;
+  for (std::size_t i = 0; i + 2 < indices.size(); i += 3) {
+    misses += cache.add_triangle(&indices[i]);
+  }
+  for (auto index : indices) {
+    referenced[index] = true;
+  }
+
+  auto unique_vertices = std::count(referenced.begin(), referenced.end(), true);
+  stats.acmr = static_cast<float>(misses) / (indices.size() / 3);
+  stats.atvr = static_cast<float>(misses) / unique_vertices;
+  return stats;
+}
+
+void optimize_vertex_cache(std::vector<unsigned int>& indices,
+                           std::size_t vertex_count) {
+  std::size_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0) {
+    return;
+  }
+
+  // Triangles using each vertex. The live triangles of vertex v are stored in
+  // adjacency[offsets[v], offsets[v] + remaining[v]).
+  std::vector<unsigned> remaining(vertex_count, 0);
+  for (std::size_t i = 0; i < triangle_count * 3; ++i) {
+    ++remaining[indices[i]];
+  }
+  std::vector<unsigned> offsets(vertex_count + 1, 0);
+  std::partial_sum(remaining.begin(), remaining.end(), offsets.begin() + 1);
+  std::vector<unsigned> adjacency(triangle_count * 3);
+  {
+    std::vector<unsigned> fill(offsets.begin(), offsets.end() - 1);
+    for (std::size_t i = 0; i < triangle_count * 3; ++i) {
+      adjacency[fill[indices[i]]++] = i / 3;
+    }
+  }
+
+  std::vector<float> vertex_score(vertex_count);
+  for (std::size_t v = 0; v < vertex_count; ++v) {
+    vertex_score[v] = forsyth_vertex_score(-1, remaining[v]);
+  }
+  std::vector<bool> emitted(triangle_count, false);
+
+  std::vector<unsigned> cache, next_cache;
+  cache.reserve(forsyth_cache_size + 3);
+  next_cache.reserve(forsyth_cache_size + 3);
+  std::vector<unsigned int> result;
+  result.reserve(triangle_count * 3);
+
+  std::size_t scan = 0;
+  long best = -1;
+  for (std::size_t count = 0; count < triangle_count; ++count) {
+    if (best < 0) {
+      // No candidate around the cache, continue with the next triangle which
+      // has not been drawn yet
+      while (emitted[scan]) {
+        ++scan;
+      }
+      best = scan;
+    }
+
+    const unsigned int* triangle = &indices[best * 3];
+    result.insert(result.end(), triangle, triangle + 3);
+    emitted[best] = true;
+
+    // Remove the triangle from the live triangles of its vertices
+    for (int k = 0; k < 3; ++k) {
+      auto v = triangle[k];
+      auto first = adjacency.begin() + offsets[v];
+      auto last = first + remaining[v];
+      auto it = std::find(first, last, static_cast<unsigned>(best));
+      std::iter_swap(it, last - 1);
+      --remaining[v];
+    }
+
+    // Move the triangle's vertices to the front of the LRU cache
+    next_cache.assign(triangle, triangle + 3);
+    for (auto v : cache) {
+      if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+        next_cache.push_back(v);
+      }
+    }
+    for (std::size_t i = 0; i < next_cache.size(); ++i) {
+      auto v = next_cache[i];
+      int position = i < forsyth_cache_size ? static_cast<int>(i) : -1;
+      vertex_score[v] = forsyth_vertex_score(position, remaining[v]);
+    }
+    if (next_cache.size() > forsyth_cache_size) {
+      next_cache.resize(forsyth_cache_size);
+    }
+    std::swap(cache, next_cache);
+
+    // Rescore the triangles around the cache and pick the best one
+    best = -1;
+    float best_score = -std::numeric_limits<float>::max();
+    for (auto v : cache) {
+      for (unsigned i = 0; i < remaining[v]; ++i) {
+        auto t = adjacency[offsets[v] + i];
+        float score = vertex_score[indices[t * 3]] +
+                      vertex_score[indices[t * 3 + 1]] +
+                      vertex_score[indices[t * 3 + 2]];
+        if (score > best_score) {
+          best_score = score;
+          best = t;
+        }
+      }
+    }
+  }
+
+  indices = std::move(result);
+}
+
+void optimize_overdraw(std::vector<unsigned int>& indices,
+                       const std::vector<Vertex>& vertices, float threshold) {
+  constexpr unsigned cache_size = 16;
+  std::size_t triangle_count = indices.size() / 3;
+  if (triangle_count == 0) {
+    return;
+  }
+
+  // Hard boundaries: triangles which miss the cache on all of their vertices,
+  // where the optimizer had to jump to a new part of the mesh
+  std::vector<std::size_t> hard_boundaries{0};
+  {
+    FifoCache cache(vertices.size(), cache_size);
+    for (std::size_t t = 0; t < triangle_count; ++t) {
+      if (cache.add_triangle(&indices[t * 3]) == 3 && t > 0) {
+        hard_boundaries.push_back(t);
+      }
+    }
+  }
+  hard_boundaries.push_back(triangle_count);
+
+  // Soft boundaries: split clusters further wherever the running ACMR since
+  // the last split stays within threshold of the cluster's ACMR
+  std::vector<std::size_t> boundaries;
+  {
+    FifoCache cache(vertices.size(), cache_size);
+    for (std::size_t c = 0; c + 1 < hard_boundaries.size(); ++c) {
+      auto start = hard_boundaries[c], end = hard_boundaries[c + 1];
+
+      cache.flush();
+      unsigned cluster_misses = 0;
+      for (auto t = start; t < end; ++t) {
+        cluster_misses += cache.add_triangle(&indices[t * 3]);
+      }
+      float cluster_threshold =
+          threshold * static_cast<float>(cluster_misses) / (end - start);
+
+      cache.flush();
+      boundaries.push_back(start);
+      unsigned misses = 0;
+      auto split = start;
+      for (auto t = start; t < end; ++t) {
+        misses += cache.add_triangle(&indices[t * 3]);
+        if (t + 1 < end &&
+            static_cast<float>(misses) / (t + 1 - split) <= cluster_threshold) {
+          boundaries.push_back(t + 1);
+          split = t + 1;
+          misses = 0;
+          cache.flush();
+        }
+      }
+    }
+  }
+  boundaries.push_back(triangle_count);
+
+  // Sort clusters by how much they face away from the center of the mesh
+  std::size_t cluster_count = boundaries.size() - 1;
+  std::vector<Vector> centroids(cluster_count), normals(cluster_count);
+  Vector mesh_centroid(0.0f, 0.0f, 0.0f);
+  float mesh_area = 0.0f;
+  for (std::size_t c = 0; c < cluster_count; ++c) {
+    Vector centroid(0.0f, 0.0f, 0.0f), normal(0.0f, 0.0f, 0.0f);
+    float area = 0.0f;
+    for (auto t = boundaries[c]; t < boundaries[c + 1]; ++t) {
+      const auto& p0 = vertices[indices[t * 3]].pos;
+      const auto& p1 = vertices[indices[t * 3 + 1]].pos;
+      const auto& p2 = vertices[indices[t * 3 + 2]].pos;
+      // Twice the area weighted normal
+      auto n = cross(p1 - p0, p2 - p0);
+      float weight = std::sqrt(dot(n, n));
+      centroid = centroid + (p0 + p1 + p2) * (weight / 3.0f);
+      normal = normal + n;
+      area += weight;
+    }
+
+    mesh_centroid = mesh_centroid + centroid;
+    mesh_area += area;
+    centroids[c] = area > 0.0f ? centroid * (1.0f / area) : centroid;
+    float normal_length = std::sqrt(dot(normal, normal));
+    normals[c] = normal_length > 0.0f ? normal * (1.0f / normal_length) : normal;
+  }
+  if (mesh_area > 0.0f) {
+    mesh_centroid = mesh_centroid * (1.0f / mesh_area);
+  }
+
+  std::vector<float> sort_keys(cluster_count);
+  for (std::size_t c = 0; c < cluster_count; ++c) {
+    sort_keys[c] = dot(centroids[c] - mesh_centroid, normals[c]);
+  }
+
+  std::vector<std::size_t> order(sort_keys.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(),
+                   [&](std::size_t a, std::size_t b) {
+                     return sort_keys[a] > sort_keys[b];
+                   });
+
+  std::vector<unsigned int> result;
+  result.reserve(indices.size());
+  for (auto c : order) {
+    result.insert(result.end(), indices.begin() + boundaries[c] * 3,
+                  indices.begin() + boundaries[c + 1] * 3);
+  }
+  indices = std::move(result);
+}
+
+void optimize_vertex_fetch(std::vector<Vertex>& vertices,
+                           std::vector<unsigned int>& indices) {
+  std::vector<unsigned> remap(vertices.size(), no_vertex);
+  unsigned next = 0;
+  for (auto& index : indices) {
+    if (remap[index] == no_vertex) {
+      remap[index] = next++;
+    }
+    index = remap[index];
+  }
+
+  std::vector<Vertex> result(next);
+  for (std::size_t v = 0; v < vertices.size(); ++v) {
+    if (remap[v] != no_vertex) {
+      result[remap[v]] = vertices[v];
+    }
+  }
+  vertices = std::move(result);
+}
+
+void optimize_mesh(MeshData& mesh) {
+  auto before = analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+
+  optimize_vertex_cache(mesh.indices, mesh.vertices.size());
+  optimize_overdraw(mesh.indices, mesh.vertices);
+  optimize_vertex_fetch(mesh.vertices, mesh.indices);
+
+  auto after = analyze_vertex_cache(mesh.indices, mesh.vertices.size());
+  qDebug() << ":: Optimized index buffer: ACMR" << before.acmr << "->"
+           << after.acmr << ", ATVR" << before.atvr << "->" << after.atvr;
+}
@@ -0,0 +1,43 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "mesh_data.h"
+#include "vertex.h"
+
+// Efficiency of an index buffer on a simulated FIFO post-transform cache
+struct VertexCacheStats {
+  // Average cache miss ratio: transformed vertices per triangle, 0.5 to 3
+  float acmr = 0.0f;
+  // Average transform to vertex ratio: transformed vertices per vertex, >= 1
+  float atvr = 0.0f;
+};
+
+VertexCacheStats analyze_vertex_cache(const std::vector<unsigned int>& indices,
+                                      std::size_t vertex_count,
+                                      unsigned cache_size = 16);
+
+// Reorders triangles to reuse recently transformed vertices as much as
+// possible (Tom Forsyth's linear-speed vertex cache optimization)
+void optimize_vertex_cache(std::vector<unsigned int>& indices,
+                           std::size_t vertex_count);
+
+// Splits a cache-optimized index buffer into clusters and sorts them so that
+// outward-facing clusters are drawn first, which occlude the rest.
+// Clusters are only split where the ACMR stays within threshold times the
+// original one.
+void optimize_overdraw(std::vector<unsigned int>& indices,
+                       const std::vector<Vertex>& vertices,
+                       float threshold = 1.05f);
+
+// Reorders vertices in the order the index buffer first references them, and
+// drops unreferenced vertices
+void optimize_vertex_fetch(std::vector<Vertex>& vertices,
+                           std::vector<unsigned int>& indices);
+
+// Runs all of the above and logs the cache efficiency before and after
+void optimize_mesh(MeshData& mesh);
+
+#endif // MESH_OPTIMIZER_H
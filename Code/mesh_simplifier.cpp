@@ -0,0 +1,505 @@
+#include <QDebug>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+
+namespace {
+// Symmetric 4x4 matrix measuring the squared distance to a set of planes,
+// weighted by the area of the triangles spanning them
+struct Quadric {
+  double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+  double a11 = 0, a12 = 0, a13 = 0;
+  double a22 = 0, a23 = 0;
+  double a33 = 0;
+  double weight = 0;
+
+  static Quadric from_plane(double a, double b, double c, double d,
+                            double weight) {
+    Quadric q;
+    q.a00 = a * a * weight, q.a01 = a * b * weight, q.a02 = a * c * weight;
+    q.a03 = a * d * weight;
+    q.a11 = b * b * weight, q.a12 = b * c * weight, q.a13 = b * d * weight;
+    q.a22 = c * c * weight, q.a23 = c * d * weight;
+    q.a33 = d * d * weight;
+    q.weight = weight;
+    return q;
+  }
+
+  Quadric& operator+=(const Quadric& o) {
+    a00 += o.a00, a01 += o.a01, a02 += o.a02, a03 += o.a03;
+    a11 += o.a11, a12 += o.a12, a13 += o.a13;
+    a22 += o.a22, a23 += o.a23;
+    a33 += o.a33;
+    weight += o.weight;
+    return *this;
+  }
+
+  // Mean squared distance of p to the planes, weighted by their area
+  double error(const Vector& p) const {
+    if (weight == 0) {
+      return 0.0;
+    }
+    double x = p.x, y = p.y, z = p.z;
+    double result = a00 * x * x + a11 * y * y + a22 * z * z + a33 +
+                    2 * (a01 * x * y + a02 * x * z + a12 * y * z) +
+                    2 * (a03 * x + a13 * y + a23 * z);
+    return std::max(result / weight, 0.0);
+  }
+};
+
+Vector operator-(const Vector& a, const Vector& b) {
+  return Vector(a.x - b.x, a.y - b.y, a.z - b.z);
+}
+
+Vector cross(const Vector& a, const Vector& b) {
+  return Vector(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z,
+                a.x * b.y - a.y * b.x);
+}
+
+float dot(const Vector& a, const Vector& b) {
+  return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+struct PositionHash {
+  std::size_t operator()(const Vector& p) const {
+    std::uint32_t bits[3];
+    std::memcpy(bits, &p, sizeof(bits));
+    return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^
+           (bits[2] * 83492791u);
+  }
+};
+
+struct PositionEqual {
+  bool operator()(const Vector& a, const Vector& b) const {
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+  }
+};
+
+// Vertices sharing a position, such as those on either side of a UV seam or
+// around a corner of a flat shaded mesh, which move together
+struct Positions {
+  // Position of every vertex
+  std::vector<unsigned> of_vertex;
+  std::vector<Vector> position;
+  // Vertices at every position, stored compactly
+  std::vector<unsigned> offsets;
+  std::vector<unsigned> vertices;
+
+  explicit Positions(const std::vector<Vertex>& mesh_vertices)
+      : of_vertex(mesh_vertices.size()), vertices(mesh_vertices.size()) {
+    std::unordered_map<Vector, unsigned, PositionHash, PositionEqual> first;
+    for (std::size_t i = 0; i < mesh_vertices.size(); ++i) {
+      auto inserted = first.emplace(mesh_vertices[i].pos,
+                                    static_cast<unsigned>(position.size()));
+      if (inserted.second) {
+        position.push_back(mesh_vertices[i].pos);
+      }
+      of_vertex[i] = inserted.first->second;
+    }
+
+    offsets.assign(position.size() + 1, 0);
+    for (auto id : of_vertex) {
+      ++offsets[id + 1];
+    }
+    for (std::size_t i = 0; i < position.size(); ++i) {
+      offsets[i + 1] += offsets[i];
+    }
+    auto fill = offsets;
+    for (std::size_t i = 0; i < of_vertex.size(); ++i) {
+      vertices[fill[of_vertex[i]]++] = static_cast<unsigned>(i);
+    }
+  }
+
+  std::size_t size() const { return position.size(); }
+  const unsigned* begin(unsigned id) const {
+    return vertices.data() + offsets[id];
+  }
+  const unsigned* end(unsigned id) const {
+    return vertices.data() + offsets[id + 1];
+  }
+};
+
+// Marks the positions on open borders, which may not be moved, from triangles
+// given by the positions of their corners
+std::vector<char> find_border_positions(std::size_t count,
+                                        const std::vector<unsigned>& indices) {
+  // An edge is on a border if no triangle uses it in the opposite direction
+  auto edge_key = [](unsigned a, unsigned b) {
+    return (static_cast<std::uint64_t>(a) << 32) | b;
+  };
+  std::unordered_set<std::uint64_t> edges;
+  edges.reserve(indices.size());
+  for (std::size_t i = 0; i < indices.size(); i += 3) {
+    for (int k = 0; k < 3; ++k) {
+      edges.insert(edge_key(indices[i + k], indices[i + (k + 1) % 3]));
+    }
+  }
+  std::vector<char> border(count, 0);
+  for (auto edge : edges) {
+    auto a = static_cast<unsigned>(edge >> 32);
+    auto b = static_cast<unsigned>(edge);
+    if (edges.count(edge_key(b, a)) == 0) {
+      border[a] = border[b] = 1;
+    }
+  }
+  return border;
+}
+
+// Triangles around every vertex, stored compactly
+struct Adjacency {
+  std::vector<unsigned> offsets;
+  std::vector<unsigned> triangles;
+
+  Adjacency(const std::vector<unsigned int>& indices,
+            std::size_t vertex_count)
+      : offsets(vertex_count + 1, 0), triangles(indices.size()) {
+    for (auto index : indices) {
+      ++offsets[index + 1];
+    }
+    for (std::size_t i = 0; i < vertex_count; ++i) {
+      offsets[i + 1] += offsets[i];
+    }
+    auto fill = offsets;
+    for (std::size_t i = 0; i < indices.size(); ++i) {
+      triangles[fill[indices[i]]++] = static_cast<unsigned>(i / 3);
+    }
+  }
+
+  const unsigned* begin(unsigned vertex) const {
+    return triangles.data() + offsets[vertex];
+  }
+  const unsigned* end(unsigned vertex) const {
+    return triangles.data() + offsets[vertex + 1];
+  }
+};
+
+struct Collapse {
+  unsigned from, to;
+  double cost;
+};
+
+bool has_vertex(const unsigned int* triangle, unsigned vertex) {
+  return triangle[0] == vertex || triangle[1] == vertex ||
+         triangle[2] == vertex;
+}
+
+// Whether moving from onto to keeps the surface a manifold without folding
+// any of the triangles around from, all given by positions
+bool is_valid_collapse(const std::vector<Vector>& positions,
+                       const std::vector<unsigned>& indices,
+                       const Adjacency& adjacency, unsigned from,
+                       unsigned to) {
+  // Vertices adjacent to both ends may only be the ones of the triangles on
+  // the collapsed edge
+  int shared_triangles = 0;
+  std::vector<unsigned> from_ring;
+  for (auto t = adjacency.begin(from); t != adjacency.end(from); ++t) {
+    const auto* triangle = &indices[*t * 3];
+    if (has_vertex(triangle, to)) {
+      ++shared_triangles;
+    }
+    from_ring.insert(from_ring.end(), triangle, triangle + 3);
+  }
+  std::sort(from_ring.begin(), from_ring.end());
+  from_ring.erase(std::unique(from_ring.begin(), from_ring.end()),
+                  from_ring.end());
+
+  std::vector<unsigned> common;
+  for (auto t = adjacency.begin(to); t != adjacency.end(to); ++t) {
+    for (int k = 0; k < 3; ++k) {
+      auto vertex = indices[*t * 3 + k];
+      if (vertex != from && vertex != to &&
+          std::binary_search(from_ring.begin(), from_ring.end(), vertex)) {
+        common.push_back(vertex);
+      }
+    }
+  }
+  std::sort(common.begin(), common.end());
+  common.erase(std::unique(common.begin(), common.end()), common.end());
+  if (shared_triangles == 0 ||
+      common.size() != static_cast<std::size_t>(shared_triangles)) {
+    return false;
+  }
+
+  const auto& target = positions[to];
+  for (auto t = adjacency.begin(from); t != adjacency.end(from); ++t) {
+    const auto* triangle = &indices[*t * 3];
+    if (has_vertex(triangle, to)) {
+      continue;
+    }
+    Vector before[3], after[3];
+    for (int k = 0; k < 3; ++k) {
+      before[k] = positions[triangle[k]];
+      after[k] = triangle[k] == from ? target : before[k];
+    }
+    auto normal_before = cross(before[1] - before[0], before[2] - before[0]);
+    auto normal_after = cross(after[1] - after[0], after[2] - after[0]);
+    if (dot(normal_before, normal_after) <= 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool same_coords(const TexCoord& a, const TexCoord& b) {
+  return a.u == b.u && a.v == b.v;
+}
+
+// Finds the vertex at position to that each vertex at position from moves
+// onto. Vertices of the triangles on the collapsed edge move onto their
+// corner at to. Their texture coordinates at both ends tell which coordinates
+// at to continue those at from, the other vertices move onto a vertex with
+// the continued coordinates and the closest normal. Fails when a vertex has
+// coordinates no edge triangle continues, as moving it would tear the UV seam
+// it lies on.
+bool find_targets(const std::vector<Vertex>& vertices,
+                  const Positions& positions,
+                  const std::vector<unsigned int>& indices,
+                  const Adjacency& adjacency, unsigned from, unsigned to,
+                  std::vector<std::pair<unsigned, unsigned>>& targets) {
+  constexpr auto none = std::numeric_limits<unsigned>::max();
+  // Coordinates at from and at to across the edge triangles
+  std::vector<std::pair<TexCoord, TexCoord>> continued;
+  targets.clear();
+  for (auto vertex = positions.begin(from); vertex != positions.end(from);
+       ++vertex) {
+    auto target = none;
+    for (auto t = adjacency.begin(*vertex); t != adjacency.end(*vertex); ++t) {
+      for (int k = 0; k < 3; ++k) {
+        auto corner = indices[*t * 3 + k];
+        if (positions.of_vertex[corner] != to) {
+          continue;
+        }
+        if (target != none && target != corner) {
+          return false;
+        }
+        target = corner;
+      }
+    }
+    if (target == none) {
+      continue;
+    }
+    const auto& coords = vertices[*vertex].coords;
+    for (const auto& pair : continued) {
+      if (same_coords(pair.first, coords) &&
+          !same_coords(pair.second, vertices[target].coords)) {
+        return false;
+      }
+    }
+    continued.emplace_back(coords, vertices[target].coords);
+    targets.emplace_back(*vertex, target);
+  }
+  if (targets.empty()) {
+    return false;
+  }
+
+  for (auto vertex = positions.begin(from); vertex != positions.end(from);
+       ++vertex) {
+    const auto& moved = vertices[*vertex];
+    auto on_edge = std::any_of(
+        targets.begin(), targets.end(),
+        [&](const std::pair<unsigned, unsigned>& target) {
+          return target.first == *vertex;
+        });
+    if (on_edge || adjacency.begin(*vertex) == adjacency.end(*vertex)) {
+      continue;
+    }
+    auto pair = std::find_if(
+        continued.begin(), continued.end(),
+        [&](const std::pair<TexCoord, TexCoord>& pair) {
+          return same_coords(pair.first, moved.coords);
+        });
+    if (pair == continued.end()) {
+      return false;
+    }
+
+    auto target = none;
+    float closest = -2.0f;
+    for (auto other = positions.begin(to); other != positions.end(to);
+         ++other) {
+      const auto& candidate = vertices[*other];
+      auto alignment = dot(candidate.normal, moved.normal);
+      if (same_coords(candidate.coords, pair->second) && alignment > closest) {
+        closest = alignment;
+        target = *other;
+      }
+    }
+    if (target == none) {
+      return false;
+    }
+    targets.emplace_back(*vertex, target);
+  }
+  return true;
+}
+} // namespace
+
+std::vector<unsigned int> simplify_mesh(const std::vector<Vertex>& vertices,
+                                        const std::vector<unsigned int>& indices,
+                                        std::size_t target_index_count,
+                                        float max_error, float* error) {
+  auto vertex_count = vertices.size();
+  Positions positions(vertices);
+  auto position_count = positions.size();
+  auto to_positions = [&](const std::vector<unsigned int>& vertex_indices) {
+    std::vector<unsigned> position_indices(vertex_indices.size());
+    for (std::size_t i = 0; i < vertex_indices.size(); ++i) {
+      position_indices[i] = positions.of_vertex[vertex_indices[i]];
+    }
+    return position_indices;
+  };
+  auto border = find_border_positions(position_count, to_positions(indices));
+
+  // Every position starts with the planes of the triangles around it
+  std::vector<Quadric> quadrics(position_count);
+  for (std::size_t i = 0; i < indices.size(); i += 3) {
+    const auto& a = vertices[indices[i]].pos;
+    const auto& b = vertices[indices[i + 1]].pos;
+    const auto& c = vertices[indices[i + 2]].pos;
+    auto normal = cross(b - a, c - a);
+    auto length = std::sqrt(dot(normal, normal));
+    if (length == 0.0f) {
+      continue;
+    }
+    normal = Vector(normal.x / length, normal.y / length, normal.z / length);
+    auto plane = Quadric::from_plane(normal.x, normal.y, normal.z,
+                                     -dot(normal, a), length / 2.0f);
+    for (int k = 0; k < 3; ++k) {
+      quadrics[positions.of_vertex[indices[i + k]]] += plane;
+    }
+  }
+
+  auto result = indices;
+  auto max_cost = static_cast<double>(max_error) * max_error;
+  double worst_cost = 0.0;
+  std::vector<std::pair<unsigned, unsigned>> targets;
+
+  // Collapse a batch of independent edges per pass, so that the adjacency
+  // only needs to be rebuilt once per pass. Edges collapse between
+  // positions, moving all vertices at one end.
+  while (result.size() > target_index_count) {
+    auto result_positions = to_positions(result);
+    Adjacency adjacency(result, vertex_count);
+    Adjacency position_adjacency(result_positions, position_count);
+
+    std::vector<Collapse> candidates;
+    candidates.reserve(result.size() * 2);
+    for (std::size_t i = 0; i < result_positions.size(); i += 3) {
+      for (int k = 0; k < 3; ++k) {
+        auto a = result_positions[i + k];
+        auto b = result_positions[i + (k + 1) % 3];
+        for (auto edge : {std::make_pair(a, b), std::make_pair(b, a)}) {
+          if (border[edge.first]) {
+            continue;
+          }
+          auto combined = quadrics[edge.first];
+          combined += quadrics[edge.second];
+          auto cost = combined.error(positions.position[edge.second]);
+          if (cost <= max_cost) {
+            candidates.push_back({edge.first, edge.second, cost});
+          }
+        }
+      }
+    }
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Collapse& a, const Collapse& b) {
+                return a.cost < b.cost;
+              });
+
+    std::vector<unsigned> collapse_to(vertex_count);
+    for (std::size_t i = 0; i < vertex_count; ++i) {
+      collapse_to[i] = static_cast<unsigned>(i);
+    }
+    std::vector<char> touched(position_count, 0);
+    auto triangles_to_remove = (result.size() - target_index_count) / 3;
+    std::size_t triangles_removed = 0;
+    for (const auto& collapse : candidates) {
+      if (triangles_removed >= triangles_to_remove) {
+        break;
+      }
+      if (touched[collapse.from] || touched[collapse.to] ||
+          !is_valid_collapse(positions.position, result_positions,
+                             position_adjacency, collapse.from,
+                             collapse.to) ||
+          !find_targets(vertices, positions, result, adjacency, collapse.from,
+                        collapse.to, targets)) {
+        continue;
+      }
+
+      for (const auto& target : targets) {
+        collapse_to[target.first] = target.second;
+      }
+      quadrics[collapse.to] += quadrics[collapse.from];
+      worst_cost = std::max(worst_cost, collapse.cost);
+      for (auto t = position_adjacency.begin(collapse.from);
+           t != position_adjacency.end(collapse.from); ++t) {
+        const auto* triangle = &result_positions[*t * 3];
+        if (has_vertex(triangle, collapse.to)) {
+          ++triangles_removed;
+        }
+        for (int k = 0; k < 3; ++k) {
+          touched[triangle[k]] = 1;
+        }
+      }
+    }
+    if (triangles_removed == 0) {
+      break;
+    }
+
+    // Triangles on a collapsed edge now have two corners at one position
+    std::size_t write = 0;
+    for (std::size_t i = 0; i < result.size(); i += 3) {
+      auto a = collapse_to[result[i]];
+      auto b = collapse_to[result[i + 1]];
+      auto c = collapse_to[result[i + 2]];
+      auto pa = positions.of_vertex[a];
+      auto pb = positions.of_vertex[b];
+      auto pc = positions.of_vertex[c];
+      if (pa != pb && pb != pc && pa != pc) {
+        result[write++] = a;
+        result[write++] = b;
+        result[write++] = c;
+      }
+    }
+    result.resize(write);
+  }
+
+  if (error) {
+    *error = static_cast<float>(std::sqrt(worst_cost));
+  }
+  return result;
+}
+
+void generate_lods(MeshData& mesh, std::size_t max_lods) {
+  auto full_count = static_cast<quint32>(mesh.indices.size());
+  mesh.lods.assign(1, MeshLod{0, full_count, 0.0f});
+
+  // Every level is simplified from the full mesh, so errors do not compound
+  const std::vector<unsigned int> full(mesh.indices.begin(),
+                                       mesh.indices.end());
+  while (mesh.lods.size() < max_lods) {
+    auto previous_count = mesh.lods.back().index_count;
+    auto target = previous_count / 6 * 3;
+    float error = 0.0f;
+    auto lod = simplify_mesh(mesh.vertices, full, target,
+                             std::numeric_limits<float>::infinity(), &error);
+    // Stop once simplification stalls, e.g. on seams everywhere
+    if (lod.size() > previous_count * 3 / 4) {
+      break;
+    }
+
+    optimize_vertex_cache(lod, mesh.vertices.size());
+    mesh.lods.push_back(MeshLod{static_cast<quint32>(mesh.indices.size()),
+                                static_cast<quint32>(lod.size()), error});
+    mesh.indices.insert(mesh.indices.end(), lod.begin(), lod.end());
+    qDebug() << ":: LOD" << mesh.lods.size() - 1 << ":" << lod.size() / 3
+             << "triangles, error" << error;
+  }
+}
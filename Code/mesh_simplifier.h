@@ -0,0 +1,34 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "mesh_data.h"
+#include "vertex.h"
+
+// Reduces the triangle count by collapsing edges in order of increasing
+// quadric error (Garland & Heckbert), moving one end of the edge onto the
+// other so that the vertex buffer can be shared with the original mesh.
+// Vertices sharing a position, i.e. on either side of a UV or normal seam, are
+// welded and move together, each onto the vertex at the other end that
+// continues its texture coordinates, which keeps UV seams intact. Vertices on
+// open borders are never moved.
+// Stops once the index count reaches target_index_count or when no collapse
+// stays within max_error. The error of a collapse is the root mean square
+// distance, weighted by area, of the remaining vertex to the planes of the
+// triangles merged into it. The largest error of any collapse, in mesh units,
+// is stored in error if given. It estimates the distance to the original
+// surface rather than bounding it.
+std::vector<unsigned int> simplify_mesh(const std::vector<Vertex>& vertices,
+                                        const std::vector<unsigned int>& indices,
+                                        std::size_t target_index_count,
+                                        float max_error,
+                                        float* error = nullptr);
+
+// Fills in mesh.lods, appending a simplified index buffer with half the
+// triangles of the previous level for every LOD, until max_lods levels exist
+// or the mesh cannot be simplified any further
+void generate_lods(MeshData& mesh, std::size_t max_lods = 4);
+
+#endif // MESH_SIMPLIFIER_H
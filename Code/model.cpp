@@ -1,58 +1,164 @@
 #include "model.h"
 
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QHash>
 #include <QTextStream>
+#include <QThread>
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <limits>
 
-Model::Model(QString filename) {
+#include "mapped_file.h"
+#include "obj_parser.h"
+
+namespace {
+// Packed (position, normal, uv) tuple identifying a vertex during welding.
+// Each component holds either the bit pattern of the float, or the float
+// quantized to a grid of epsilon-sized cells.
+struct WeldKey {
+  quint32 components[8];
+
+  bool operator==(const WeldKey& other) const {
+    return std::memcmp(components, other.components, sizeof(components)) == 0;
+  }
+};
+
+inline quint32 rotl(quint32 x, int r) { return (x << r) | (x >> (32 - r)); }
+
+// MurmurHash3 over the packed components
+uint qHash(const WeldKey& key, uint seed = 0) {
+  quint32 hash = seed;
+  for (quint32 k : key.components) {
+    k *= 0xcc9e2d51;
+    k = rotl(k, 15);
+    k *= 0x1b873593;
+    hash ^= k;
+    hash = rotl(hash, 13);
+    hash = hash * 5 + 0xe6546b64;
+  }
+  hash ^= sizeof(key.components);
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+quint32 packComponent(float value, float epsilon) {
+  if (epsilon > 0.0f) {
+    auto cell = static_cast<qint32>(std::floor(value / epsilon + 0.5f));
+    return static_cast<quint32>(cell);
+  }
+  // -0.0 and 0.0 compare equal, so they must map to the same key
+  if (value == 0.0f) {
+    value = 0.0f;
+  }
+  quint32 bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+WeldKey makeWeldKey(const QVector3D& v, const QVector3D& n, const QVector2D& t,
+                    float epsilon) {
+  return WeldKey{{packComponent(v.x(), epsilon), packComponent(v.y(), epsilon),
+                  packComponent(v.z(), epsilon), packComponent(n.x(), epsilon),
+                  packComponent(n.y(), epsilon), packComponent(n.z(), epsilon),
+                  packComponent(t.x(), epsilon),
+                  packComponent(t.y(), epsilon)}};
+}
+
+} // namespace
+
+Model::Model(QString filename, ModelOptions options) : options(options) {
   hNorms = false;
   hTexs = false;
 
   qDebug() << ":: Loading model:" << filename;
   QFile file(filename);
   if (file.open(QIODevice::ReadOnly)) {
-    QTextStream in(&file);
+    QElapsedTimer timer;
+    timer.start();
 
-    QString line;
-    QStringList tokens;
+    if (options.parser == ModelOptions::Parser::Mapped) {
+      parseMapped(file);
+    } else {
+      parseTextStream(file);
+    }
 
-    while (!in.atEnd()) {
-      line = in.readLine();
-      if (line.startsWith("#"))
-        continue; // skip comments
+    parseStats.bytes = file.size();
+    parseStats.elapsedNs = timer.nsecsElapsed();
+    qDebug() << ":: Parsed" << parseStats.bytes << "bytes in"
+             << parseStats.elapsedNs / 1.0e6 << "ms ("
+             << parseStats.megabytesPerSecond() << "MB/s)";
 
-      tokens = line.split(" ", QString::SkipEmptyParts);
+    file.close();
 
-      // Switch depending on first element
-      if (tokens[0] == "v") {
-        parseVertex(tokens);
-      }
+    // Allign all vertex indices with the right normal/texturecoord indices
+    alignData();
+  }
+}
 
-      if (tokens[0] == "vn") {
-        parseNormal(tokens);
-      }
+void Model::parseTextStream(QFile& file) {
+  QTextStream in(&file);
 
-      if (tokens[0] == "vt") {
-        parseTexture(tokens);
-      }
+  QString line;
+  QStringList tokens;
 
-      if (tokens[0] == "f") {
-        parseFace(tokens);
-      }
+  while (!in.atEnd()) {
+    line = in.readLine();
+    if (line.startsWith("#"))
+      continue; // skip comments
+
+    tokens = line.split(" ", QString::SkipEmptyParts);
+
+    // Switch depending on first element
+    if (tokens[0] == "v") {
+      parseVertex(tokens);
     }
 
-    file.close();
+    if (tokens[0] == "vn") {
+      parseNormal(tokens);
+    }
 
-    // create an array version of the data
-    unpackIndexes();
+    if (tokens[0] == "vt") {
+      parseTexture(tokens);
+    }
 
-    // Allign all vertex indices with the right normal/texturecoord indices
-    alignData();
+    if (tokens[0] == "f") {
+      parseFace(tokens);
+    }
   }
 }
 
+/**
+ * @brief Model::parseMapped
+ *
+ * Parse the file by scanning its contents in place, splitting large files
+ * into chunks which are parsed in parallel
+ */
+void Model::parseMapped(QFile& file) {
+  MappedFile contents(file);
+
+  int threads = options.threads > 0 ? options.threads
+                                    : std::max(QThread::idealThreadCount(), 1);
+  ObjData data;
+  parse_obj_parallel(contents.data(), contents.data() + contents.size(), data,
+                     threads);
+
+  hNorms = !data.normals.isEmpty();
+  hTexs = !data.texcoords.isEmpty();
+  positions = std::move(data.positions);
+  norm = std::move(data.normals);
+  tex = std::move(data.texcoords);
+  position_indices = std::move(data.position_indices);
+  texcoord_indices = std::move(data.texcoord_indices);
+  normal_indices = std::move(data.normal_indices);
+}
+
 /**
  *
  * Unitize the model by scaling so that it fits a box with sides 1
@@ -67,38 +173,76 @@ void Model::unitize() {
   auto min_x = std::numeric_limits<float>::max();
   auto min_y = std::numeric_limits<float>::max();
   auto min_z = std::numeric_limits<float>::max();
-  for (const auto& vertex : vertices_indexed) {
-    max_x = std::max(max_x, vertex.x());
-    max_y = std::max(max_y, vertex.y());
-    max_z = std::max(max_z, vertex.z());
-    min_x = std::min(min_x, vertex.x());
-    min_y = std::min(min_y, vertex.y());
-    min_z = std::min(min_z, vertex.z());
+  for (const auto& vertex : vertexData) {
+    max_x = std::max(max_x, vertex.pos.x);
+    max_y = std::max(max_y, vertex.pos.y);
+    max_z = std::max(max_z, vertex.pos.z);
+    min_x = std::min(min_x, vertex.pos.x);
+    min_y = std::min(min_y, vertex.pos.y);
+    min_z = std::min(min_z, vertex.pos.z);
   }
   auto center = QVector3D(max_x + min_x, max_y + min_y, max_z + min_z) / 2.0f;
   auto max_extent = std::max({max_x - min_x, max_y - min_y, max_z - min_z});
-  for (auto& vertex : vertices_indexed) {
-    vertex = (vertex - center) / (max_extent / 2.0f);
+  for (auto& vertex : vertexData) {
+    auto unitized = (QVector3D(vertex.pos.x, vertex.pos.y, vertex.pos.z) -
+                     center) /
+                    (max_extent / 2.0f);
+    vertex.pos = Vector(unitized);
   }
+  clearDerived();
 }
 
-QVector<QVector3D> Model::getVertices() { return vertices; }
+const std::vector<Vertex>& Model::getVertexData() const { return vertexData; }
 
-QVector<QVector3D> Model::getNormals() { return normals; }
+const std::vector<unsigned>& Model::getIndexData() const { return indexData; }
 
-QVector<QVector2D> Model::getTextureCoords() { return textureCoords; }
+MeshData Model::takeMeshData() {
+  MeshData mesh;
+  mesh.vertices = std::move(vertexData);
+  mesh.indices = std::move(indexData);
+  vertexData.clear();
+  indexData.clear();
+  clearDerived();
+  return mesh;
+}
 
-QVector<QVector3D> Model::getVertices_indexed() { return vertices_indexed; }
+const QVector<QVector3D>& Model::getVertices() {
+  unpackIndexes();
+  return vertices;
+}
 
-QVector<QVector3D> Model::getNormals_indexed() { return normals_indexed; }
+const QVector<QVector3D>& Model::getNormals() {
+  unpackIndexes();
+  return normals;
+}
+
+const QVector<QVector2D>& Model::getTextureCoords() {
+  unpackIndexes();
+  return textureCoords;
+}
 
-QVector<QVector2D> Model::getTextureCoords_indexed() {
+const QVector<QVector3D>& Model::getVertices_indexed() {
+  splitIndexed();
+  return vertices_indexed;
+}
+
+const QVector<QVector3D>& Model::getNormals_indexed() {
+  splitIndexed();
+  return normals_indexed;
+}
+
+const QVector<QVector2D>& Model::getTextureCoords_indexed() {
+  splitIndexed();
   return textureCoords_indexed;
 }
 
-QVector<unsigned> Model::getIndices() { return indices; }
+const QVector<unsigned>& Model::getIndices() {
+  splitIndexed();
+  return indices;
+}
 
 QVector<float> Model::getVNInterleaved() {
+  unpackIndexes();
   QVector<float> buffer;
 
   for (int i = 0; i != vertices.size(); ++i) {
@@ -116,6 +260,7 @@ QVector<float> Model::getVNInterleaved() {
 }
 
 QVector<float> Model::getVNTInterleaved() {
+  unpackIndexes();
   QVector<float> buffer;
 
   for (int i = 0; i != vertices.size(); ++i) {
@@ -136,6 +281,7 @@ QVector<float> Model::getVNTInterleaved() {
 }
 
 QVector<float> Model::getVNInterleaved_indexed() {
+  splitIndexed();
   QVector<float> buffer;
 
   for (int i = 0; i != vertices_indexed.size(); ++i) {
@@ -153,6 +299,7 @@ QVector<float> Model::getVNInterleaved_indexed() {
 }
 
 QVector<float> Model::getVNTInterleaved_indexed() {
+  splitIndexed();
   QVector<float> buffer;
 
   for (int i = 0; i != vertices_indexed.size(); ++i) {
@@ -179,14 +326,25 @@ QVector<float> Model::getVNTInterleaved_indexed() {
  *
  * @return number of triangles
  */
-int Model::getNumTriangles() { return vertices.size() / 3; }
+int Model::getNumTriangles() { return indexData.size() / 3; }
+
+const Model::ParseStats& Model::getParseStats() const { return parseStats; }
+
+const Model::WeldStats& Model::getWeldStats() const { return weldStats; }
+
+double Model::ParseStats::megabytesPerSecond() const {
+  if (elapsedNs == 0) {
+    return 0.0;
+  }
+  return (bytes / (1024.0 * 1024.0)) / (elapsedNs / 1.0e9);
+}
 
 void Model::parseVertex(QStringList tokens) {
   float x, y, z;
   x = tokens[1].toFloat();
   y = tokens[2].toFloat();
   z = tokens[3].toFloat();
-  vertices_indexed.append(QVector3D(x, y, z));
+  positions.append(QVector3D(x, y, z));
 }
 
 void Model::parseNormal(QStringList tokens) {
@@ -212,7 +370,7 @@ void Model::parseFace(QStringList tokens) {
   for (int i = 1; i != tokens.size(); ++i) {
     elements = tokens[i].split("/");
     // -1 since .obj count from 1
-    indices.append(elements[0].toInt() - 1);
+    position_indices.append(elements[0].toInt() - 1);
 
     if (elements.size() > 1 && !elements[1].isEmpty()) {
       texcoord_indices.append(elements[1].toInt() - 1);
@@ -229,24 +387,28 @@ void Model::parseFace(QStringList tokens) {
  *
  * Make sure that the indices from the vertices align with those
  * of the normals and the texture coordinates, create extra vertices
- * if vertex has multiple normals or texturecoords
+ * if vertex has multiple normals or texturecoords.
+ * Duplicate vertices are found through a hash table, so this is linear
+ * in the number of face corners. The welded vertices are written straight
+ * into the interleaved vertex buffer, after which the parsed records are
+ * released.
  */
 void Model::alignData() {
-  QVector<QVector3D> verts = QVector<QVector3D>();
-  verts.reserve(vertices_indexed.size());
-  QVector<QVector3D> norms = QVector<QVector3D>();
-  norms.reserve(vertices_indexed.size());
-  QVector<QVector2D> texcs = QVector<QVector2D>();
-  texcs.reserve(vertices_indexed.size());
-  QVector<Vertex> vs = QVector<Vertex>();
+  QElapsedTimer timer;
+  timer.start();
+
+  vertexData.clear();
+  vertexData.reserve(positions.size());
+  indexData.clear();
+  indexData.reserve(position_indices.size());
 
-  QVector<unsigned> ind = QVector<unsigned>();
-  ind.reserve(indices.size());
+  QHash<WeldKey, unsigned> vs;
+  vs.reserve(position_indices.size());
 
   unsigned currentIndex = 0;
 
-  for (int i = 0; i != indices.size(); ++i) {
-    QVector3D v = vertices_indexed[indices[i]];
+  for (int i = 0; i != position_indices.size(); ++i) {
+    QVector3D v = positions[position_indices[i]];
 
     QVector3D n = QVector2D(0, 0);
     if (hNorms) {
@@ -258,31 +420,61 @@ void Model::alignData() {
       t = tex[texcoord_indices[i]];
     }
 
-    Vertex k = Vertex(v, n, t);
-    if (vs.contains(k)) {
+    WeldKey k = makeWeldKey(v, n, t, options.weldEpsilon);
+    auto existing = vs.constFind(k);
+    if (existing != vs.constEnd()) {
       // Vertex already exists, use that index
-      ind.append(vs.indexOf(k));
+      indexData.push_back(existing.value());
     } else {
       // Create a new vertex
-      verts.append(v);
-      norms.append(n);
-      texcs.append(t);
-      vs.append(k);
-      ind.append(currentIndex);
+      vertexData.push_back(Vertex{Vector(v), Vector(n), TexCoord(t)});
+      vs.insert(k, currentIndex);
+      indexData.push_back(currentIndex);
       ++currentIndex;
     }
   }
+
+  weldStats.inputVertices = position_indices.size();
+  weldStats.uniqueVertices = currentIndex;
+  weldStats.elapsedNs = timer.nsecsElapsed();
+  qDebug() << ":: Welded" << weldStats.inputVertices << "vertices into"
+           << weldStats.uniqueVertices << "in"
+           << weldStats.elapsedNs / 1.0e6 << "ms";
+
   // Remove old data
-  vertices_indexed.clear();
-  normals_indexed.clear();
-  textureCoords_indexed.clear();
-  indices.clear();
+  positions = QVector<QVector3D>();
+  norm = QVector<QVector3D>();
+  tex = QVector<QVector2D>();
+  position_indices = QVector<unsigned>();
+  normal_indices = QVector<unsigned>();
+  texcoord_indices = QVector<unsigned>();
+}
 
-  // Set the new data
-  vertices_indexed = verts;
-  normals_indexed = norms;
-  textureCoords_indexed = texcs;
-  indices = ind;
+/**
+ * @brief Model::splitIndexed
+ *
+ * Split the welded vertices into separate arrays per attribute
+ *
+ */
+void Model::splitIndexed() {
+  if (splitDone) {
+    return;
+  }
+  vertices_indexed.reserve(vertexData.size());
+  normals_indexed.reserve(vertexData.size());
+  textureCoords_indexed.reserve(vertexData.size());
+  for (const auto& vertex : vertexData) {
+    vertices_indexed.append(
+        QVector3D(vertex.pos.x, vertex.pos.y, vertex.pos.z));
+    normals_indexed.append(
+        QVector3D(vertex.normal.x, vertex.normal.y, vertex.normal.z));
+    textureCoords_indexed.append(QVector2D(vertex.coords.u, vertex.coords.v));
+  }
+  indices.reserve(indexData.size());
+  for (auto index : indexData) {
+    indices.append(index);
+  }
+  splitDone = true;
 }
 
 /**
@@ -292,18 +484,35 @@ void Model::alignData() {
  *
  */
 void Model::unpackIndexes() {
-  vertices.clear();
-  normals.clear();
-  textureCoords.clear();
-  for (int i = 0; i != indices.size(); ++i) {
-    vertices.append(vertices_indexed[indices[i]]);
+  if (unpackDone) {
+    return;
+  }
+  for (auto index : indexData) {
+    const auto& vertex = vertexData[index];
+    vertices.append(QVector3D(vertex.pos.x, vertex.pos.y, vertex.pos.z));
 
     if (hNorms) {
-      normals.append(norm[normal_indices[i]]);
+      normals.append(
+          QVector3D(vertex.normal.x, vertex.normal.y, vertex.normal.z));
     }
 
     if (hTexs) {
-      textureCoords.append(tex[texcoord_indices[i]]);
+      textureCoords.append(QVector2D(vertex.coords.u, vertex.coords.v));
     }
   }
+  unpackDone = true;
+}
+
+// Drops the derived arrays, after the welded geometry changed
+void Model::clearDerived() {
+  vertices_indexed.clear();
+  normals_indexed.clear();
+  textureCoords_indexed.clear();
+  indices.clear();
+  splitDone = false;
+
+  vertices.clear();
+  normals.clear();
+  textureCoords.clear();
+  unpackDone = false;
 }
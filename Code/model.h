@@ -6,6 +6,31 @@
 #include <QVector2D>
 #include <QVector3D>
 #include <QVector>
+#include <QtGlobal>
+
+#include <vector>
+
+#include "mesh_data.h"
+#include "vertex.h"
+
+class QFile;
+
+// Options controlling how a Model is loaded
+struct ModelOptions {
+  enum class Parser {
+    TextStream, // QTextStream/QString tokenizer
+    Mapped,     // In-place scanner over the mapped file contents
+  };
+
+  Parser parser = Parser::Mapped;
+
+  // Worker threads used by the mapped parser, 0 picks one per core
+  int threads = 0;
+
+  // 0 only merges bitwise-identical vertices, a positive value merges vertices
+  // whose components fall within the same epsilon-sized cell
+  float weldEpsilon = 0.0f;
+};
 
 /**
  * @brief The Model class
@@ -18,22 +43,45 @@
  */
 class Model {
 public:
-  Model(QString filename);
+  // Statistics gathered while welding identical vertices together
+  struct WeldStats {
+    int inputVertices = 0;
+    int uniqueVertices = 0;
+    qint64 elapsedNs = 0;
+  };
+
+  // Size and duration of the OBJ parsing step
+  struct ParseStats {
+    qint64 bytes = 0;
+    qint64 elapsedNs = 0;
+
+    double megabytesPerSecond() const;
+  };
+
+  Model(QString filename, ModelOptions options = ModelOptions());
+
+  // The welded vertices, interleaved the way Mesh uploads them. This is the
+  // only copy of the geometry kept after loading, the getters below derive
+  // their arrays from it on first use.
+  const std::vector<Vertex>& getVertexData() const;
+  const std::vector<unsigned>& getIndexData() const;
+  // Moves the welded geometry out of the model, leaving it empty
+  MeshData takeMeshData();
 
   // Used for glDrawArrays()
-  QVector<QVector3D> getVertices();
-  QVector<QVector3D> getNormals();
-  QVector<QVector2D> getTextureCoords();
+  const QVector<QVector3D>& getVertices();
+  const QVector<QVector3D>& getNormals();
+  const QVector<QVector2D>& getTextureCoords();
 
   // Used for interleaving into one buffer for glDrawArrays()
   QVector<float> getVNInterleaved();
   QVector<float> getVNTInterleaved();
 
   // Used for glDrawElements()
-  QVector<QVector3D> getVertices_indexed();
-  QVector<QVector3D> getNormals_indexed();
-  QVector<QVector2D> getTextureCoords_indexed();
-  QVector<unsigned> getIndices();
+  const QVector<QVector3D>& getVertices_indexed();
+  const QVector<QVector3D>& getNormals_indexed();
+  const QVector<QVector2D>& getTextureCoords_indexed();
+  const QVector<unsigned>& getIndices();
 
   // Used for interleaving into one buffer for glDrawElements()
   QVector<float> getVNInterleaved_indexed();
@@ -42,32 +90,16 @@ public:
   bool hasNormals();
   bool hasTextureCoords();
   int getNumTriangles();
+  const ParseStats& getParseStats() const;
+  const WeldStats& getWeldStats() const;
 
   void unitize();
 
 private:
-  // A Vertex class for vertex comparison
-  struct Vertex {
-    QVector3D coord;
-    QVector3D normal;
-    QVector2D texCoord;
-
-    Vertex() : coord(), normal(), texCoord() {}
-    Vertex(QVector3D coords, QVector3D normal, QVector3D texc)
-        : coord(coords), normal(normal), texCoord(texc) {}
-
-    bool operator==(const Vertex& other) const {
-      if (other.coord != coord)
-        return false;
-      if (other.normal != normal)
-        return false;
-      if (other.texCoord != texCoord)
-        return false;
-      return true;
-    }
-  };
-
   // OBJ parsing
+  void parseTextStream(QFile& file);
+  void parseMapped(QFile& file);
+
   void parseVertex(QStringList tokens);
   void parseNormal(QStringList tokens);
   void parseTexture(QStringList tokens);
@@ -75,26 +107,40 @@ private:
 
   // Alignment of data
   void alignData();
+  void splitIndexed();
   void unpackIndexes();
+  void clearDerived();
+
+  // Records as parsed, released once aligned
+  QVector<QVector3D> positions;
+  QVector<QVector3D> norm;
+  QVector<QVector2D> tex;
+  QVector<unsigned> position_indices;
+  QVector<unsigned> normal_indices;
+  QVector<unsigned> texcoord_indices;
 
-  // Intermediate storage of values
+  // Welded geometry
+  std::vector<Vertex> vertexData;
+  std::vector<unsigned> indexData;
+
+  // Arrays derived from the welded geometry on demand
   QVector<QVector3D> vertices_indexed;
   QVector<QVector3D> normals_indexed;
   QVector<QVector2D> textureCoords_indexed;
   QVector<unsigned> indices;
+  bool splitDone = false;
 
   QVector<QVector3D> vertices;
   QVector<QVector3D> normals;
   QVector<QVector2D> textureCoords;
-
-  // Utility storage
-  QVector<unsigned> normal_indices;
-  QVector<unsigned> texcoord_indices;
-  QVector<QVector3D> norm;
-  QVector<QVector2D> tex;
+  bool unpackDone = false;
 
   bool hNorms;
   bool hTexs;
+
+  ModelOptions options;
+  ParseStats parseStats;
+  WeldStats weldStats;
 };
 
 #endif // MODEL_H
@@ -0,0 +1,275 @@
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "obj_parser.h"
+
+namespace {
+inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+const char* skip_spaces(const char* p, const char* end) {
+  while (p != end && is_space(*p)) {
+    ++p;
+  }
+  return p;
+}
+
+const char* skip_line(const char* p, const char* end) {
+  while (p != end && *p != '\n') {
+    ++p;
+  }
+  return p == end ? p : p + 1;
+}
+
+// Powers of ten which are exactly representable as doubles
+const double powers_of_ten[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                1e18, 1e19, 1e20, 1e21, 1e22};
+constexpr int max_exact_power = 22;
+
+double scale_by_power_of_ten(double value, int exponent) {
+  while (exponent > max_exact_power) {
+    value *= powers_of_ten[max_exact_power];
+    exponent -= max_exact_power;
+  }
+  while (exponent < -max_exact_power) {
+    value /= powers_of_ten[max_exact_power];
+    exponent += max_exact_power;
+  }
+  return exponent >= 0 ? value * powers_of_ten[exponent]
+                       : value / powers_of_ten[-exponent];
+}
+
+// Decodes a decimal number such as "-12.5e-3", advancing p past it
+float parse_float(const char*& p, const char* end) {
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+
+  // Only the first 19 significant digits fit in the mantissa, the rest only
+  // affect the exponent
+  std::uint64_t mantissa = 0;
+  int significant_digits = 0;
+  int exponent = 0;
+  auto accumulate = [&](char c) {
+    if (significant_digits == 19) {
+      return false;
+    }
+    mantissa = mantissa * 10 + (c - '0');
+    if (mantissa != 0) {
+      ++significant_digits;
+    }
+    return true;
+  };
+
+  for (; p != end && is_digit(*p); ++p) {
+    if (!accumulate(*p)) {
+      ++exponent;
+    }
+  }
+  if (p != end && *p == '.') {
+    for (++p; p != end && is_digit(*p); ++p) {
+      if (accumulate(*p)) {
+        --exponent;
+      }
+    }
+  }
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    ++p;
+    bool negative_exponent = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+      negative_exponent = *p == '-';
+      ++p;
+    }
+    int explicit_exponent = 0;
+    for (; p != end && is_digit(*p); ++p) {
+      if (explicit_exponent < 10000) {
+        explicit_exponent = explicit_exponent * 10 + (*p - '0');
+      }
+    }
+    exponent += negative_exponent ? -explicit_exponent : explicit_exponent;
+  }
+
+  auto value = scale_by_power_of_ten(static_cast<double>(mantissa), exponent);
+  return static_cast<float>(negative ? -value : value);
+}
+
+long parse_int(const char*& p, const char* end) {
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = *p == '-';
+    ++p;
+  }
+  long value = 0;
+  for (; p != end && is_digit(*p); ++p) {
+    value = value * 10 + (*p - '0');
+  }
+  return negative ? -value : value;
+}
+
+// .obj indices count from 1, negative ones count back from the last element
+unsigned resolve_index(long index, int count) {
+  return static_cast<unsigned>(index < 0 ? count + index : index - 1);
+}
+
+bool starts_number(const char* p, const char* end) {
+  return p != end && (is_digit(*p) || *p == '-' || *p == '+' || *p == '.');
+}
+
+QVector3D parse_vec3(const char*& p, const char* end) {
+  float xyz[3];
+  for (auto& component : xyz) {
+    p = skip_spaces(p, end);
+    component = parse_float(p, end);
+  }
+  return QVector3D(xyz[0], xyz[1], xyz[2]);
+}
+
+QVector2D parse_vec2(const char*& p, const char* end) {
+  float uv[2];
+  for (auto& component : uv) {
+    p = skip_spaces(p, end);
+    component = parse_float(p, end);
+  }
+  return QVector2D(uv[0], uv[1]);
+}
+
+void append_index(long index, int count, QVector<unsigned>& indices,
+                  QVector<int>& relative_indices) {
+  if (index < 0) {
+    relative_indices.append(indices.size());
+  }
+  indices.append(resolve_index(index, count));
+}
+
+void parse_face(const char*& p, const char* end, ObjData& data) {
+  for (;;) {
+    p = skip_spaces(p, end);
+    if (!starts_number(p, end)) {
+      break;
+    }
+    append_index(parse_int(p, end), data.positions.size(),
+                 data.position_indices, data.relative_position_indices);
+
+    if (p != end && *p == '/') {
+      ++p;
+      if (starts_number(p, end)) {
+        append_index(parse_int(p, end), data.texcoords.size(),
+                     data.texcoord_indices, data.relative_texcoord_indices);
+      }
+      if (p != end && *p == '/') {
+        ++p;
+        if (starts_number(p, end)) {
+          append_index(parse_int(p, end), data.normals.size(),
+                       data.normal_indices, data.relative_normal_indices);
+        }
+      }
+    }
+
+    // Skip whatever is left of a malformed element
+    while (p != end && !is_space(*p) && *p != '\n') {
+      ++p;
+    }
+  }
+}
+
+// Appends the indices of a chunk, shifting its relative indices by the number
+// of elements parsed in the preceding chunks
+void merge_indices(QVector<unsigned>& indices, QVector<int>& relative_indices,
+                   const QVector<unsigned>& chunk_indices,
+                   const QVector<int>& chunk_relative_indices, unsigned base) {
+  int first = indices.size();
+  indices += chunk_indices;
+  for (int offset : chunk_relative_indices) {
+    indices[first + offset] += base;
+    relative_indices.append(first + offset);
+  }
+}
+
+void merge_chunk(ObjData& data, const ObjData& chunk) {
+  merge_indices(data.position_indices, data.relative_position_indices,
+                chunk.position_indices, chunk.relative_position_indices,
+                data.positions.size());
+  merge_indices(data.texcoord_indices, data.relative_texcoord_indices,
+                chunk.texcoord_indices, chunk.relative_texcoord_indices,
+                data.texcoords.size());
+  merge_indices(data.normal_indices, data.relative_normal_indices,
+                chunk.normal_indices, chunk.relative_normal_indices,
+                data.normals.size());
+  data.positions += chunk.positions;
+  data.texcoords += chunk.texcoords;
+  data.normals += chunk.normals;
+}
+} // namespace
+
+void parse_obj(const char* begin, const char* end, ObjData& data) {
+  const char* p = begin;
+  while (p != end) {
+    p = skip_spaces(p, end);
+    if (p == end) {
+      break;
+    }
+
+    // Switch depending on the record type, anything unknown is skipped
+    if (p[0] == 'v' && p + 1 != end) {
+      if (is_space(p[1])) {
+        p += 1;
+        data.positions.append(parse_vec3(p, end));
+      } else if (p[1] == 'n' && p + 2 != end && is_space(p[2])) {
+        p += 2;
+        data.normals.append(parse_vec3(p, end));
+      } else if (p[1] == 't' && p + 2 != end && is_space(p[2])) {
+        p += 2;
+        data.texcoords.append(parse_vec2(p, end));
+      }
+    } else if (p[0] == 'f' && p + 1 != end && is_space(p[1])) {
+      p += 1;
+      parse_face(p, end, data);
+    }
+
+    p = skip_line(p, end);
+  }
+}
+
+void parse_obj_parallel(const char* begin, const char* end, ObjData& data,
+                        int threads, std::size_t min_chunk_size) {
+  auto size = static_cast<std::size_t>(end - begin);
+  auto chunk_count = std::max<std::size_t>(
+      1, std::min<std::size_t>(threads, size / std::max<std::size_t>(
+                                                  min_chunk_size, 1)));
+  if (chunk_count == 1) {
+    parse_obj(begin, end, data);
+    return;
+  }
+
+  // Split at line boundaries, so that every chunk holds whole records
+  std::vector<const char*> bounds{begin};
+  for (std::size_t i = 1; i < chunk_count; ++i) {
+    const char* split = std::max(begin + size * i / chunk_count, bounds.back());
+    split = std::find(split, end, '\n');
+    bounds.push_back(split == end ? end : split + 1);
+  }
+  bounds.push_back(end);
+
+  // The calling thread parses the first chunk itself
+  std::vector<ObjData> chunks(chunk_count);
+  std::vector<std::thread> workers;
+  for (std::size_t i = 1; i < chunk_count; ++i) {
+    workers.emplace_back(
+        [&, i] { parse_obj(bounds[i], bounds[i + 1], chunks[i]); });
+  }
+  parse_obj(bounds[0], bounds[1], chunks[0]);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  data = std::move(chunks[0]);
+  for (std::size_t i = 1; i < chunk_count; ++i) {
+    merge_chunk(data, chunks[i]);
+  }
+}
@@ -0,0 +1,41 @@
+#ifndef OBJ_PARSER_H
+#define OBJ_PARSER_H
+
+#include <QVector2D>
+#include <QVector3D>
+#include <QVector>
+
+#include <cstddef>
+
+// Raw records of a Wavefront .obj file. Face indices are already converted to
+// 0-based indices into the attribute arrays.
+struct ObjData {
+  QVector<QVector3D> positions;
+  QVector<QVector3D> normals;
+  QVector<QVector2D> texcoords;
+
+  QVector<unsigned> position_indices;
+  QVector<unsigned> texcoord_indices;
+  QVector<unsigned> normal_indices;
+
+  // Offsets of the entries in the index arrays which came from negative
+  // (relative) .obj indices. These are resolved against the elements parsed
+  // so far, and need to be shifted when merging separately parsed chunks.
+  QVector<int> relative_position_indices;
+  QVector<int> relative_texcoord_indices;
+  QVector<int> relative_normal_indices;
+};
+
+// Scans the v/vn/vt/f records of the text in [begin, end) in place.
+// Numbers are decoded straight from the buffer, so no allocations happen
+// besides the growth of the output arrays.
+void parse_obj(const char* begin, const char* end, ObjData& data);
+
+// Splits the text at line boundaries into one chunk per thread, parses the
+// chunks in parallel and merges the results in order.
+// Chunks are never smaller than min_chunk_size bytes, so small files are
+// parsed on fewer threads.
+void parse_obj_parallel(const char* begin, const char* end, ObjData& data,
+                        int threads, std::size_t min_chunk_size = 1 << 17);
+
+#endif // OBJ_PARSER_H
@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <cstring>
+
+#include "render_queue.h"
+
+namespace {
+// Widths of the key's fields, from the most significant one
+constexpr int water_bits = 1;
+constexpr int diffuse_bits = 8;
+constexpr int wave_mask_bits = 8;
+constexpr int material_bits = 13;
+constexpr int mesh_bits = 10;
+constexpr int depth_bits = 24;
+static_assert(water_bits + diffuse_bits + wave_mask_bits + material_bits +
+                      mesh_bits + depth_bits ==
+                  64,
+              "Sort key fields must fill 64 bits");
+
+// Non-negative floats order like their bits, of which the lowest bits of the
+// mantissa are dropped
+std::uint64_t depth_key(float depth) {
+  depth = std::max(depth, 0.0f);
+  std::uint32_t bits;
+  std::memcpy(&bits, &depth, sizeof(bits));
+  return bits >> (32 - depth_bits);
+}
+} // namespace
+
+void RenderQueue::clear() {
+  draw_items.clear();
+  diffuse_ids.clear();
+  wave_mask_ids.clear();
+  material_ids.clear();
+  mesh_ids.clear();
+}
+
+void RenderQueue::add(MeshInstance& instance, float view_depth) {
+  const auto& material = *instance.material;
+  std::uint64_t key = material.is_water;
+  key = key << diffuse_bits |
+        id(diffuse_ids, &material.diffuse->array(), diffuse_bits);
+  key = key << wave_mask_bits |
+        id(wave_mask_ids, &material.wave_mask->array(), wave_mask_bits);
+  key = key << material_bits | id(material_ids, &material, material_bits);
+  key = key << mesh_bits | id(mesh_ids, instance.mesh.get(), mesh_bits);
+  key = key << depth_bits | depth_key(view_depth);
+  draw_items.push_back({key, &instance});
+}
+
+void RenderQueue::sort() {
+  std::sort(draw_items.begin(), draw_items.end(),
+            [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+}
+
+std::uint64_t RenderQueue::id(QHash<const void*, std::uint64_t>& ids,
+                              const void* state, int bits) {
+  auto it = ids.find(state);
+  if (it == ids.end()) {
+    // States beyond what the field holds share its last id, which only
+    // makes the order less ideal
+    auto next = std::min<std::uint64_t>(ids.size(), (1u << bits) - 1);
+    it = ids.insert(state, next);
+  }
+  return *it;
+}
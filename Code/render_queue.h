@@ -0,0 +1,64 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <QHash>
+
+#include <cstdint>
+#include <vector>
+
+#include "mesh.h"
+
+struct DrawItem {
+  std::uint64_t key;
+  MeshInstance* instance;
+};
+
+// State set while submitting draws, and set again for nothing
+struct RenderStats {
+  int draws = 0;
+  // Drawn by the draws, several per draw when drawn instanced
+  int instances = 0;
+  int state_changes = 0;
+  int state_changes_avoided = 0;
+  // glUniform calls, outside of uniform blocks
+  int uniform_calls = 0;
+  int uniform_calls_avoided = 0;
+
+  RenderStats& operator+=(const RenderStats& other) {
+    draws += other.draws;
+    instances += other.instances;
+    state_changes += other.state_changes;
+    state_changes_avoided += other.state_changes_avoided;
+    uniform_calls += other.uniform_calls;
+    uniform_calls_avoided += other.uniform_calls_avoided;
+    return *this;
+  }
+};
+
+// The meshes of a pass, sorted so that consecutive draws share as much state
+// as possible. Keys order by the wave uniforms, then the diffuse and wave mask
+// texture arrays, then the material, then the mesh, so that instances of a
+// mesh with the same material follow each other and are drawn together, and
+// finally front to back by view depth, so that meshes sharing all state are
+// drawn with early depth tests rejecting as many of their fragments as
+// possible.
+class RenderQueue {
+public:
+  void clear();
+  void add(MeshInstance& instance, float view_depth);
+  void sort();
+
+  const std::vector<DrawItem>& items() const { return draw_items; }
+
+private:
+  // Dense ids, numbered in the order they are first added, so that they fit
+  // into the fields of the keys
+  std::uint64_t id(QHash<const void*, std::uint64_t>& ids, const void* state,
+                   int bits);
+
+  std::vector<DrawItem> draw_items;
+  QHash<const void*, std::uint64_t> diffuse_ids, wave_mask_ids, material_ids,
+      mesh_ids;
+};
+
+#endif // RENDER_QUEUE_H
@@ -1,156 +1,429 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+#include "gl_state.h"
 #include "shader.h"
 
-ShaderInstance::ShaderInstance(const QString& vertpath,
-                               const QString& fragpath) {
-  initializeOpenGLFunctions();
+namespace {
+// Waves swaying the leaves, for all meshes
+const float wave_amplitude[] = {0.01f, 0.02f, 0.05f};
+const float wave_frequency[] = {500.0f, 0.2f, 0.1f};
+const float wave_phase[] = {0.0f, 1.0f, 2.0f};
 
-  compile_shaders(vertpath, fragpath);
+// Waves of water meshes
+const float water_amplitude[] = {0.1f, 0.08f, 0.3f, 0.2f, 0.04f, 0.12f};
+const float water_frequency[] = {17.0f, 20.0f, 5.0f, 6.0f, 16.0f, 4.9f};
+const float water_phase[] = {0.0f, 3.0f, 7.0f, 0.5f, 2.5f, 1.3f};
 
-  find_uniforms();
-}
+// Levels finer than the projected texel density requests, as anisotropic
+// filtering samples finer levels on surfaces seen at an angle
+constexpr int mip_feedback_bias = 1;
 
-void ShaderInstance::draw(Scene& scene, const QMatrix4x4& view_matrix,
-                          const QMatrix4x4& proj_matrix) {
-  program.bind();
-  bind_global_uniforms(scene.time, view_matrix, proj_matrix);
+// Upper bound of how far the vertex shaders move any vertex, in mesh units
+float max_vertex_offset(const Material& material) {
+  float offset = 0.0f;
+  if (material.is_water) {
+    for (auto amplitude : water_amplitude) {
+      offset += std::abs(amplitude);
+    }
+  } else {
+    for (auto amplitude : wave_amplitude) {
+      offset += std::abs(amplitude);
+    }
+  }
+  return offset;
+}
 
-  for (auto& mesh : scene.meshes) {
-    draw_mesh(mesh, scene.light, view_matrix);
+// How far the water waves sampled at vertices spacing apart in texture
+// coordinates may stray from the waves, in mesh units. Between two samples a
+// wave deviates from the straight line by up to its amplitude times
+// 1 - cos(pi * frequency * spacing), and by twice its amplitude once the
+// samples are half a period apart.
+float wave_sampling_error(float spacing) {
+  constexpr float pi = 3.14159265f;
+  float error = 0.0f;
+  for (int i = 0; i < 6; ++i) {
+    auto angle = std::min(pi * water_frequency[i] * spacing, pi);
+    error += std::abs(water_amplitude[i]) * (1.0f - std::cos(angle));
   }
+  return error;
 }
 
-void ShaderInstance::draw(Mesh& mesh) {
-  program.bind();
-  mesh.draw();
+PassBlock pass_block(const Scene& scene, const QMatrix4x4& view,
+                     const QMatrix4x4& projection) {
+  PassBlock block = {};
+  std::copy_n(view.constData(), 16, block.view);
+  std::copy_n(projection.constData(), 16, block.projection);
+  const auto& light = scene.light;
+  block.light_position[0] = light.pos.x;
+  block.light_position[1] = light.pos.y;
+  block.light_position[2] = light.pos.z;
+  block.light_color[0] = light.color.x;
+  block.light_color[1] = light.color.y;
+  block.light_color[2] = light.color.z;
+  block.time = scene.time;
+  return block;
 }
 
-void ShaderInstance::uniform(const char* name, int value) {
-  program.bind();
-  glUniform1i(program.uniformLocation(name), value);
+MaterialBlock material_block(const Material& material) {
+  MaterialBlock block = {};
+  block.properties[0] = material.ka;
+  block.properties[1] = material.kd;
+  block.properties[2] = material.ks;
+  block.properties[3] = material.exp;
+  block.diffuse_layer = material.diffuse->layer();
+  block.wave_mask_layer = material.wave_mask->layer();
+  block.is_water = material.is_water;
+
+  // Water has six waves, other meshes three
+  const float* amplitude = material.is_water ? water_amplitude : wave_amplitude;
+  const float* frequency = material.is_water ? water_frequency : wave_frequency;
+  const float* phase = material.is_water ? water_phase : wave_phase;
+  int waves = material.is_water ? 6 : 3;
+  for (int i = 0; i < waves; ++i) {
+    block.amplitude[i].value = amplitude[i];
+    block.frequency[i].value = frequency[i];
+    block.phase[i].value = phase[i];
+  }
+  return block;
 }
 
-void ShaderInstance::uniform(const char* name, const QMatrix4x4& value) {
-  program.bind();
-  glUniformMatrix4fv(program.uniformLocation(name), 1, GL_FALSE, value.data());
+DrawBlock draw_block(const Mesh& mesh) {
+  DrawBlock block = {};
+  // Float vertices decode with an identity offset and scale
+  const auto& decode = mesh.position_decode();
+  std::memcpy(block.position_offset, &decode.offset,
+              sizeof(block.position_offset));
+  std::memcpy(block.position_scale, &decode.scale,
+              sizeof(block.position_scale));
+  block.octahedral_normals = mesh.vertex_format() == VertexFormat::Octahedral;
+  return block;
 }
 
-void ShaderInstance::draw_mesh(MeshInstance& instance, const Light& light,
-                               const QMatrix4x4& view_matrix) {
-  bind_mesh_uniforms(instance, view_matrix, light);
-  instance.mesh.draw();
+InstanceAttributes instance_attributes(const MeshInstance& instance,
+                                       const QMatrix4x4& view) {
+  InstanceAttributes attributes;
+  auto model = to_matrix(instance.transform);
+  std::copy_n(model.constData(), 16, attributes.model);
+
+  // Normal matrix is relative to view space
+  auto normal_matrix = (view * model).normalMatrix();
+  std::copy_n(normal_matrix.constData(), 9, attributes.normal_matrix);
+  attributes.seed = instance.seed;
+  return attributes;
 }
+} // namespace
 
-void ShaderInstance::compile_shaders(const QString& vertpath,
-                                     const QString& fragpath) {
-  qDebug() << "Loading vertex shader:" << vertpath;
-  program.addShaderFromSourceFile(QOpenGLShader::Vertex, vertpath);
-  qDebug() << "Loading fragment shader:" << fragpath;
-  program.addShaderFromSourceFile(QOpenGLShader::Fragment, fragpath);
-  program.link();
+ShaderInstance::ShaderInstance(const QString& vertpath,
+                               const QString& fragpath) {
+  initializeOpenGLFunctions();
+
+  compile_shaders(vertpath, fragpath);
+
+  find_uniforms();
 }
 
-void ShaderInstance::find_uniforms() {
-  model_uniform = program.uniformLocation("model");
-  view_uniform = program.uniformLocation("view");
-  projection_uniform = program.uniformLocation("projection");
-  normal_mat_uniform = program.uniformLocation("normal_matrix");
-  material_diffuse_uniform = program.uniformLocation("material_diffuse");
-  material_properties_uniform = program.uniformLocation("material_properties");
-  light_position_uniform = program.uniformLocation("light_position");
-  light_color_uniform = program.uniformLocation("light_color");
-  amplitude_uniform = program.uniformLocation("amplitude");
-  freq_uniform = program.uniformLocation("frequency");
-  phase_uniform = program.uniformLocation("phase");
-  time_uniform = program.uniformLocation("time");
-  wave_mask_uniform = program.uniformLocation("wave_mask");
+ShaderInstance::~ShaderInstance() {
+  GLState::current().deleted_program(program.programId());
+}
+
+bool ShaderInstance::draw(Scene& scene, const QMatrix4x4& view_matrix,
+                          const QMatrix4x4& proj_matrix,
+                          MeshSelection selection) {
+  if (!uniforms) {
+    qDebug() << "Drawing a scene without a uniform ring";
+    return false;
+  }
+  GLState::current().use_program(program.programId());
 
-  // Only warn about required uniforms missing, as normal shader and others
-  // could lack uniforms related to materials and lights
-  if (model_uniform == -1) {
-    qDebug()
-        << "Failed to get uniform location for model transformation matrix";
+  // Other passes may have bound their own blocks in between
+  bound_material = std::size_t(-1);
+
+  bounds.clear();
+  for (const auto& mesh : scene.meshes) {
+    bounds.add(mesh.mesh->bounding_box(), mesh.mesh->bounding_sphere().radius,
+               to_matrix(mesh.transform), max_vertex_offset(*mesh.material));
   }
-  if (view_uniform == -1) {
-    qDebug() << "Failed to get uniform location for view matrix";
+  bounds.cull(Frustum(proj_matrix * view_matrix), visible);
+
+  queue.clear();
+  for (std::size_t i = 0; i < scene.meshes.size(); ++i) {
+    auto& mesh = scene.meshes[i];
+    if ((selection == MeshSelection::static_meshes && mesh.is_dynamic()) ||
+        (selection == MeshSelection::dynamic_meshes && !mesh.is_dynamic())) {
+      continue;
+    }
+    if (!visible[i]) {
+      ++culling.culled;
+      continue;
+    }
+    // Meshes appear once their textures are uploaded completely
+    if (mesh.material->is_resident()) {
+      queue.add(mesh, -view_matrix.map(mesh.transform.position).z());
+      ++culling.drawn;
+    }
   }
-  if (projection_uniform == -1) {
-    qDebug() << "Failed to get uniform location for projection matrix";
+  queue.sort();
+
+  if (!write_blocks(scene, view_matrix, proj_matrix)) {
+    return false;
   }
-  if (normal_mat_uniform == -1) {
-    qDebug() << "Failed to get uniform location for model normal matrix";
+  uniforms->bind(pass_binding, pass_offset, sizeof(PassBlock));
+  for (const auto& submission : submissions) {
+    if (changes_state(submission.material_offset != bound_material)) {
+      uniforms->bind(material_binding, submission.material_offset,
+                     sizeof(MaterialBlock));
+      bound_material = submission.material_offset;
+    }
+    bind_material_textures(*submission.material);
+    uniforms->bind(draw_binding, submission.draw_offset, sizeof(DrawBlock));
+    submission.mesh->draw_instanced(submission.lod, submission.instances,
+                                    uniforms->gl_handle(),
+                                    submission.instance_offset);
+    ++stats.draws;
+    stats.instances += submission.instances;
   }
+  return true;
 }
 
-void ShaderInstance::bind_global_uniforms(float time, const QMatrix4x4& view,
-                                          const QMatrix4x4& projection) {
-  glUniformMatrix4fv(view_uniform, 1, GL_FALSE, view.data());
-  glUniformMatrix4fv(projection_uniform, 1, GL_FALSE, projection.data());
+bool ShaderInstance::write_blocks(const Scene& scene,
+                                  const QMatrix4x4& view_matrix,
+                                  const QMatrix4x4& proj_matrix) {
+  // Groups depend on the LODs, so these are selected before writing
+  const auto& items = queue.items();
+  item_lods.clear();
+  std::size_t materials = 0, groups = 0;
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    auto& instance = *items[i].instance;
+    auto pixels = pixels_per_unit(instance, view_matrix, proj_matrix);
+    if (mip_feedback) {
+      request_mip_levels(instance, pixels);
+    }
+    item_lods.push_back(select_lod(instance, pixels));
 
-  static float amplitude[] = {0.01f, 0.02f, 0.05f};
-  static float frequency[] = {500.0f, 0.2f, 0.1f};
-  static float phase[] = {0.0f, 1.0f, 2.0f};
-  if (amplitude_uniform != -1) {
-    glUniform1fv(amplitude_uniform, 3, amplitude);
+    if (i == 0 || instance.material != items[i - 1].instance->material) {
+      ++materials;
+    }
+    if (starts_group(i)) {
+      ++groups;
+    }
   }
-  if (freq_uniform != -1) {
-    glUniform1fv(freq_uniform, 3, frequency);
+
+  // Instance attributes follow the blocks
+  auto pass_size = uniforms->aligned(sizeof(PassBlock));
+  auto material_size = uniforms->aligned(sizeof(MaterialBlock));
+  auto draw_size = uniforms->aligned(sizeof(DrawBlock));
+  auto blocks_size =
+      pass_size + materials * material_size + groups * draw_size;
+  auto mapping = uniforms->map(blocks_size +
+                               items.size() * sizeof(InstanceAttributes));
+  if (!mapping.data) {
+    return false;
   }
-  if (phase_uniform != -1) {
-    glUniform1fv(phase_uniform, 3, phase);
+
+  // Blocks are assembled on the stack, the mapped memory is only written
+  auto pass = pass_block(scene, view_matrix, proj_matrix);
+  std::memcpy(mapping.data, &pass, sizeof(pass));
+  pass_offset = mapping.offset;
+  std::size_t offset = pass_size, instance_offset = blocks_size;
+
+  submissions.clear();
+  std::size_t material_offset = 0;
+  for (std::size_t i = 0; i < items.size(); ++i) {
+    auto& instance = *items[i].instance;
+    if (i == 0 || instance.material != items[i - 1].instance->material) {
+      auto material = material_block(*instance.material);
+      std::memcpy(mapping.data + offset, &material, sizeof(material));
+      material_offset = mapping.offset + offset;
+      offset += material_size;
+    }
+
+    if (starts_group(i)) {
+      auto draw = draw_block(*instance.mesh);
+      std::memcpy(mapping.data + offset, &draw, sizeof(draw));
+      Submission submission;
+      submission.mesh = instance.mesh.get();
+      submission.material = instance.material.get();
+      submission.lod = item_lods[i];
+      submission.material_offset = material_offset;
+      submission.draw_offset = mapping.offset + offset;
+      submission.instance_offset = mapping.offset + instance_offset;
+      submissions.push_back(submission);
+      offset += draw_size;
+    }
+
+    auto attributes = instance_attributes(instance, view_matrix);
+    std::memcpy(mapping.data + instance_offset, &attributes,
+                sizeof(attributes));
+    instance_offset += sizeof(attributes);
+    ++submissions.back().instances;
+  }
+  uniforms->unmap();
+  return true;
+}
+
+CullStats ShaderInstance::take_cull_stats() {
+  auto taken = culling;
+  culling = CullStats();
+  return taken;
+}
+
+RenderStats ShaderInstance::take_render_stats() {
+  auto taken = stats;
+  stats = RenderStats();
+  auto calls = uniform_table.take_stats();
+  taken.uniform_calls = calls.calls;
+  taken.uniform_calls_avoided = calls.calls_avoided;
+  return taken;
+}
+
+void ShaderInstance::draw(Mesh& mesh) {
+  GLState::current().use_program(program.programId());
+  mesh.draw();
+}
+
+bool ShaderInstance::changes_state(bool changed) {
+  if (changed) {
+    ++stats.state_changes;
+  } else {
+    ++stats.state_changes_avoided;
   }
-  if (time_uniform != -1) {
-    glUniform1f(time_uniform, time);
+  return changed;
+}
+
+bool ShaderInstance::starts_group(std::size_t item) const {
+  if (item == 0) {
+    return true;
   }
+  const auto& items = queue.items();
+  const auto& instance = *items[item].instance;
+  const auto& previous = *items[item - 1].instance;
+  return instance.mesh != previous.mesh ||
+         instance.material != previous.material ||
+         item_lods[item] != item_lods[item - 1];
 }
 
-void ShaderInstance::bind_mesh_uniforms(MeshInstance& instance,
-                                        const QMatrix4x4& view,
-                                        const Light& light) {
-  auto model = to_matrix(instance.transform);
-  glUniformMatrix4fv(model_uniform, 1, GL_FALSE, model.data());
+int ShaderInstance::select_lod(const MeshInstance& instance,
+                               float pixels_per_unit) const {
+  const auto& mesh = *instance.mesh;
+  if (lod.max_pixel_error <= 0.0f || mesh.lod_count() < 2) {
+    return 0;
+  }
+  auto max_error = lod.max_pixel_error / pixels_per_unit;
+  if (!instance.material->is_water) {
+    return mesh.select_lod(max_error);
+  }
 
-  // Normal matrix is relative to view space
-  auto view_model = view * model;
-  glUniformMatrix3fv(normal_mat_uniform, 1, GL_FALSE,
-                     view_model.normalMatrix().data());
-
-  uniform("is_water", instance.material->is_water);
-
-  if (instance.material->is_water) {
-    static float amplitude[] = {0.1f, 0.08f, 0.3f, 0.2f, 0.04f, 0.12f};
-    static float frequency[] = {17.0f, 20.0f, 5.0f, 6.0f, 16.0f, 4.9f};
-    static float phase[] = {0.0f, 3.0f, 7.0f, 0.5f, 2.5f, 1.3f};
-    if (amplitude_uniform != -1) {
-      glUniform1fv(amplitude_uniform, 6, amplitude);
-    }
-    if (freq_uniform != -1) {
-      glUniform1fv(freq_uniform, 6, frequency);
+  // The waves are only sampled at the vertices, which coarser levels space
+  // further apart. Their height is scaled along y, whereas pixels_per_unit
+  // holds for the largest scale.
+  const auto& scale = instance.transform.scale;
+  auto max_scale = std::max({std::abs(scale.x()), std::abs(scale.y()),
+                             std::abs(scale.z())});
+  auto wave_scale = std::abs(scale.y()) / max_scale;
+  auto full_error = wave_sampling_error(mesh.uv_spacing(0));
+  for (int level = mesh.lod_count() - 1; level > 0; --level) {
+    auto wave_error = wave_sampling_error(mesh.uv_spacing(level)) - full_error;
+    if (mesh.lod_error(level) + wave_error * wave_scale <= max_error) {
+      return level;
     }
-    if (phase_uniform != -1) {
-      glUniform1fv(phase_uniform, 6, phase);
+  }
+  return 0;
+}
+
+void ShaderInstance::request_mip_levels(const MeshInstance& instance,
+                                        float pixels_per_unit) const {
+  for (auto texture : {instance.material->diffuse.get(),
+                       instance.material->wave_mask.get()}) {
+    auto& array = texture->array();
+    const auto& layout = array.layout();
+    auto texels_per_unit =
+        instance.mesh->uv_density() * std::max(layout.width, layout.height);
+
+    // Each level halves the texel density, the one matching the pixel
+    // density is sampled
+    int level = 0;
+    if (pixels_per_unit > 0.0f && texels_per_unit > pixels_per_unit) {
+      level = static_cast<int>(std::log2(texels_per_unit / pixels_per_unit));
     }
+    array.request_level(std::max(level - mip_feedback_bias, 0));
   }
+}
+
+float ShaderInstance::pixels_per_unit(const MeshInstance& instance,
+                                      const QMatrix4x4& view_matrix,
+                                      const QMatrix4x4& proj_matrix) const {
+  const auto& scale = instance.transform.scale;
+  auto max_scale = std::max({std::abs(scale.x()), std::abs(scale.y()),
+                             std::abs(scale.z())});
 
-  if (material_diffuse_uniform != -1) {
-    glActiveTexture(GL_TEXTURE0);
-    instance.material->diffuse.bind();
+  // Perspective projections shrink with the distance to the nearest point of
+  // the mesh, orthographic ones do not
+  float depth = 1.0f;
+  if (proj_matrix(3, 2) != 0.0f) {
+    const auto& sphere = instance.mesh->bounding_sphere();
+    auto center =
+        view_matrix.map(to_matrix(instance.transform).map(sphere.center));
+    depth = -center.z() - sphere.radius * max_scale;
+    if (depth <= 0.0f) {
+      return std::numeric_limits<float>::infinity();
+    }
   }
 
-  if (wave_mask_uniform != -1) {
-    glActiveTexture(GL_TEXTURE2);
-    instance.material->wave_mask.bind();
+  return proj_matrix(1, 1) * lod.viewport_height / 2.0f / depth * max_scale;
+}
+
+void ShaderInstance::compile_shaders(const QString& vertpath,
+                                     const QString& fragpath) {
+  qDebug() << "Loading vertex shader:" << vertpath;
+  program.addShaderFromSourceFile(QOpenGLShader::Vertex, vertpath);
+  qDebug() << "Loading fragment shader:" << fragpath;
+  program.addShaderFromSourceFile(QOpenGLShader::Fragment, fragpath);
+  program.link();
+}
+
+void ShaderInstance::find_uniforms() {
+  uniform_table.reflect(program.programId());
+  material_diffuse = find_uniform<int>("material_diffuse");
+  wave_mask = find_uniform<int>("wave_mask");
+
+  // Screen shaders and others declare none of the blocks, which is only a
+  // mistake for shaders drawing scenes, see set_uniform_ring
+  const std::pair<const char*, UniformBinding> blocks[] = {
+      {"Pass", pass_binding},
+      {"Material", material_binding},
+      {"Draw", draw_binding},
+      {"Shadows", shadow_binding}};
+  has_scene_blocks = true;
+  for (const auto& block : blocks) {
+    auto index = glGetUniformBlockIndex(program.programId(), block.first);
+    if (index != GL_INVALID_INDEX) {
+      glUniformBlockBinding(program.programId(), index, block.second);
+    } else if (block.second == pass_binding || block.second == draw_binding) {
+      has_scene_blocks = false;
+    }
   }
-  glActiveTexture(GL_TEXTURE0);
+}
 
-  if (material_properties_uniform != -1) {
-    glUniform4fv(material_properties_uniform, 1,
-                 reinterpret_cast<const GLfloat*>(&instance.material->ka));
+void ShaderInstance::set_uniform_ring(UniformRing* ring) {
+  uniforms = ring;
+  if (ring && !has_scene_blocks) {
+    qDebug() << "Failed to get uniform blocks Pass and Draw of a scene shader";
   }
+}
 
-  if (light_position_uniform != -1 && light_color_uniform != -1) {
-    glUniform3fv(light_position_uniform, 1,
-                 reinterpret_cast<const GLfloat*>(&light.pos));
-    glUniform3fv(light_color_uniform, 1,
-                 reinterpret_cast<const GLfloat*>(&light.color));
+void ShaderInstance::bind_material_textures(const Material& material) {
+  // Diffuse textures are sampled from unit 0, wave masks from unit 2
+  auto& state = GLState::current();
+  if (material_diffuse.is_valid()) {
+    changes_state(state.bind_texture(0, GL_TEXTURE_2D_ARRAY,
+                                     material.diffuse->array().gl_handle()));
+  }
+  if (wave_mask.is_valid()) {
+    changes_state(state.bind_texture(2, GL_TEXTURE_2D_ARRAY,
+                                     material.wave_mask->array().gl_handle()));
   }
 }
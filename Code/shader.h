@@ -5,41 +5,142 @@
 #include <QOpenGLShaderProgram>
 #include <QString>
 
+#include <cstdint>
+#include <vector>
+
+#include "frustum.h"
+#include "render_queue.h"
 #include "scene.h"
+#include "uniform_blocks.h"
+#include "uniform_ring.h"
+#include "uniform_table.h"
+
+// How coarse the mesh LODs drawn by a shader may be
+struct LodSettings {
+  // Height of the render target, in pixels
+  float viewport_height = 1.0f;
+  // Largest error a LOD may project to, in pixels. Zero always draws the full
+  // resolution meshes.
+  float max_pixel_error = 0.0f;
+};
+
+// Which of the scene's meshes a pass draws
+enum class MeshSelection { all, static_meshes, dynamic_meshes };
+
+// Meshes of the passes drawn by a shader
+struct CullStats {
+  int drawn = 0;
+  // Outside of the view frustum
+  int culled = 0;
 
-// A loaded shader program, containing locations for all of the shader's
-// uniforms, thus handling scene drawing from start to end.
+  CullStats& operator+=(const CullStats& other) {
+    drawn += other.drawn;
+    culled += other.culled;
+    return *this;
+  }
+};
+
+// A loaded shader program, containing all of the shader's uniforms, thus
+// handling scene drawing from start to end. Scene passes set their uniforms
+// as blocks sub-allocated from a uniform ring.
 class ShaderInstance : protected QOpenGLFunctions_3_3_Core {
 public:
   ShaderInstance(const QString& vertpath, const QString& fragpath);
+  ~ShaderInstance();
 
-  void draw(Scene& scene, const QMatrix4x4& view_matrix,
-            const QMatrix4x4& proj_matrix);
+  // Draws all meshes inside the view frustum, sorted by the state they need
+  // and setting only the state that differs from that of the previous mesh.
+  // Returns false when nothing was drawn as the uniform ring is full, which
+  // has more room the next frame.
+  bool draw(Scene& scene, const QMatrix4x4& view_matrix,
+            const QMatrix4x4& proj_matrix,
+            MeshSelection selection = MeshSelection::all);
 
   void draw(Mesh& mesh);
 
-  void uniform(const char* name, int value);
-  void uniform(const char* name, const QMatrix4x4& value);
+  // Where scene passes allocate their uniform blocks. Only shaders drawing
+  // scenes are given one, and must declare the Pass and Draw blocks.
+  void set_uniform_ring(UniformRing* ring);
+  void set_lod_settings(const LodSettings& settings) { lod = settings; }
+  const LodSettings& lod_settings() const { return lod; }
+  // Whether drawing requests the texture mip levels that meshes need on
+  // screen, from their projected texel density. Uses the viewport height of
+  // the LOD settings.
+  void set_mip_feedback(bool enabled) { mip_feedback = enabled; }
+
+  // Meshes drawn and culled by all passes since the last call
+  CullStats take_cull_stats();
+  // State changes and uniform calls of all passes since the last call
+  RenderStats take_render_stats();
+
+  // Resolves a uniform once, for values set every frame
+  template <typename T> Uniform<T> find_uniform(const char* name) const {
+    return uniform_table.find<T>(name);
+  }
+  // Skips the GL call when the uniform already has the value
+  template <typename T> void set(Uniform<T> uniform, const T& value) {
+    uniform_table.set(uniform, value);
+  }
+  // Resolves the uniform by name on every call, for values set once
+  template <typename T> void uniform(const char* name, const T& value) {
+    set(find_uniform<T>(name), value);
+  }
 
 private:
-  void draw_mesh(MeshInstance& instance, const Light& light,
-                 const QMatrix4x4& view_matrix);
+  // Queued instances sharing their mesh, material and LOD, drawn together
+  // with the offsets of their blocks and attributes in the uniform ring
+  struct Submission {
+    Mesh* mesh;
+    const Material* material;
+    int lod;
+    std::size_t material_offset, draw_offset, instance_offset;
+    GLsizei instances = 0;
+  };
+
+  // Writes the blocks and instance attributes of all queued meshes, returns
+  // false when they do not fit into the ring this frame
+  bool write_blocks(const Scene& scene, const QMatrix4x4& view_matrix,
+                    const QMatrix4x4& proj_matrix);
+  // Whether a queued instance cannot be drawn with the one before it
+  bool starts_group(std::size_t item) const;
+  // Counts whether state is set, or skipped as it is already set
+  bool changes_state(bool changed);
+  int select_lod(const MeshInstance& instance, float pixels_per_unit) const;
+  void request_mip_levels(const MeshInstance& instance,
+                          float pixels_per_unit) const;
+  // Size of a mesh unit in pixels at the point of the mesh nearest to the
+  // camera, infinite when the camera is inside the mesh's bounds
+  float pixels_per_unit(const MeshInstance& instance,
+                        const QMatrix4x4& view_matrix,
+                        const QMatrix4x4& proj_matrix) const;
 
   void compile_shaders(const QString& vertpath, const QString& fragpath);
   void find_uniforms();
 
-  void bind_global_uniforms(float time, const QMatrix4x4& view,
-                            const QMatrix4x4& projection);
-  void bind_mesh_uniforms(MeshInstance& instance, const QMatrix4x4& view,
-                          const Light& light);
+  void bind_material_textures(const Material& material);
 
   QOpenGLShaderProgram program;
-  GLint model_uniform, view_uniform, projection_uniform, normal_mat_uniform;
-  GLint material_diffuse_uniform, material_properties_uniform;
-  GLint light_position_uniform, light_color_uniform;
-  // Wave properties
-  GLint amplitude_uniform, freq_uniform, phase_uniform, time_uniform;
-  GLint wave_mask_uniform;
+  UniformTable uniform_table;
+  LodSettings lod;
+  bool mip_feedback = false;
+  // Bounds of the scene's meshes, and which of them the pass draws
+  BoundsBatch bounds;
+  std::vector<std::uint8_t> visible;
+  CullStats culling;
+  RenderQueue queue;
+  RenderStats stats;
+  UniformRing* uniforms = nullptr;
+  // Whether the program declares the blocks scene passes need
+  bool has_scene_blocks = false;
+  // Of the pass being drawn
+  std::size_t pass_offset = 0;
+  std::vector<Submission> submissions;
+  // Of the queued instances
+  std::vector<int> item_lods;
+  // Samplers of the material textures
+  Uniform<int> material_diffuse, wave_mask;
+  // Material block bound by the pass being drawn
+  std::size_t bound_material = 0;
 };
 
 #endif // SHADER_H
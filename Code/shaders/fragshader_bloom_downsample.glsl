@@ -0,0 +1,21 @@
+#version 330 core
+
+out vec4 color;
+
+in vec2 vert_uv;
+
+uniform sampler2D source;
+
+void main()
+{
+    // Each bilinear tap averages four texels of the level above, the five taps
+    // cover a 4x4 footprint with a bias towards its center
+    vec2 texel = 1.0 / textureSize(source, 0);
+    vec3 result = texture(source, vert_uv).rgb * 4.0;
+    result += texture(source, vert_uv + texel * vec2(-1.0, -1.0)).rgb;
+    result += texture(source, vert_uv + texel * vec2(1.0, -1.0)).rgb;
+    result += texture(source, vert_uv + texel * vec2(-1.0, 1.0)).rgb;
+    result += texture(source, vert_uv + texel * vec2(1.0, 1.0)).rgb;
+
+    color = vec4(result / 8.0, 1.0);
+}
@@ -0,0 +1,27 @@
+#version 330 core
+
+out vec4 color;
+
+in vec2 vert_uv;
+
+uniform sampler2D source;
+// Spread of the tent filter, in texels of the source
+uniform float radius;
+
+void main()
+{
+    // 3x3 tent filter, with bilinear taps smoothing between its texels
+    vec2 offset = radius / textureSize(source, 0);
+    vec3 result = texture(source, vert_uv).rgb * 4.0;
+    result += texture(source, vert_uv + vec2(-offset.x, 0.0)).rgb * 2.0;
+    result += texture(source, vert_uv + vec2(offset.x, 0.0)).rgb * 2.0;
+    result += texture(source, vert_uv + vec2(0.0, -offset.y)).rgb * 2.0;
+    result += texture(source, vert_uv + vec2(0.0, offset.y)).rgb * 2.0;
+    result += texture(source, vert_uv + vec2(-offset.x, -offset.y)).rgb;
+    result += texture(source, vert_uv + vec2(offset.x, -offset.y)).rgb;
+    result += texture(source, vert_uv + vec2(-offset.x, offset.y)).rgb;
+    result += texture(source, vert_uv + vec2(offset.x, offset.y)).rgb;
+
+    // Added to the level being upsampled into
+    color = vec4(result / 16.0, 1.0);
+}
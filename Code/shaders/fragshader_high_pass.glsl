@@ -8,12 +8,14 @@ out vec4 color;
 in vec2 vert_uv;
 
 uniform sampler2D screen_texture;
+// Luminance above which pixels bloom
+uniform float bright_threshold;
 
 void main()
 {
     color = texture(screen_texture, vert_uv);
     float brightness = dot(color.rgb, vec3(0.2126, 0.7152, 0.0722));
-    if (brightness <= 3.0) {
+    if (brightness <= bright_threshold) {
         color = vec4(0.0, 0.0, 0.0, 1.0);
     }
 }
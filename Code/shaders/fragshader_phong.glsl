@@ -2,6 +2,7 @@
 
 // Define constants
 #define M_PI 3.141593
+#define MAX_SHADOW_CASCADES 4
 
 // Specify the inputs to the fragment shader
 in vec3 vert_position;
@@ -9,27 +10,76 @@ in vec3 vert_normal;
 in vec2 vert_uv;
 in float wave_height;
 in vec3 light_view_position;
-in vec4 light_space_frag_position;
+in vec3 vert_world_position;
 
-// Material properties
-uniform sampler2D material_diffuse;
-uniform vec4 material_properties;
+// Uniform blocks, laid out as in uniform_blocks.h
+layout (std140) uniform Pass {
+    mat4 view;
+    mat4 projection;
+    vec3 light_position;
+    vec3 light_color;
+    float time;
+};
 
-uniform sampler2DShadow	shadow_map;
+layout (std140) uniform Material {
+    vec4 material_properties;
+    float diffuse_layer;
+    float wave_mask_layer;
+    bool is_water;
+    float amplitude[6];
+    float frequency[6];
+    float phase[6];
+};
 
-// Light properties
-uniform vec3 light_color;
+layout (std140) uniform Draw {
+    // Decoding of quantized vertex formats, identity for float vertices
+    vec3 position_offset;
+    vec3 position_scale;
+    bool octahedral_normals;
+};
 
-uniform bool is_water;
+// Cascades are layers of the shadow map, ordered from near to far. Lower
+// resolution cascades only fill part of their layer.
+layout (std140) uniform Shadows {
+    mat4 light_space[MAX_SHADOW_CASCADES];
+    float cascade_far[MAX_SHADOW_CASCADES];
+    float cascade_scale[MAX_SHADOW_CASCADES];
+    float cascade_bias_scale[MAX_SHADOW_CASCADES];
+    int shadow_cascade_count;
+};
 
-out vec4 color;
+// Material textures are layers of texture arrays
+uniform sampler2DArray material_diffuse;
+uniform sampler2DArrayShadow shadow_map;
+
+// Luminance above which pixels bloom
+uniform float bright_threshold;
+
+layout (location = 0) out vec4 color;
+// Only drawn into when the bright pass is fused with this pass
+layout (location = 1) out vec4 bright_color;
 
 float shadow_test() {
+    // The nearest cascade reaching the fragment, beyond the last one nothing
+    // is shadowed
+    float depth = -vert_position.z;
+    int cascade = 0;
+    while (cascade < shadow_cascade_count && depth > cascade_far[cascade]) {
+        ++cascade;
+    }
+    if (cascade == shadow_cascade_count) {
+        return 1.0;
+    }
+
+    // Cascades with larger texels need a larger bias against shadow acne
     float bias = max(0.05 * (1.0 - dot(vert_normal, light_view_position)), 0.005);
-    vec3 proj_coords = light_space_frag_position.xyz / light_space_frag_position.w;
+    bias *= cascade_bias_scale[cascade];
+    vec4 light_space_position = light_space[cascade] * vec4(vert_world_position, 1.0);
+    vec3 proj_coords = light_space_position.xyz / light_space_position.w;
     proj_coords = proj_coords * 0.5 + 0.5;
+    proj_coords.xy = clamp(proj_coords.xy, 0.0, 1.0) * cascade_scale[cascade];
     proj_coords.z -= bias;
-    return texture(shadow_map, proj_coords);
+    return texture(shadow_map, vec4(proj_coords.xy, cascade, proj_coords.z));
 }
 
 void main()
@@ -39,7 +89,7 @@ void main()
     vec3 V = normalize(-vert_position);
     vec3 R = reflect(-L, vert_normal);
 
-    vec4 tex_out = texture(material_diffuse, vert_uv);
+    vec4 tex_out = texture(material_diffuse, vec3(vert_uv, diffuse_layer));
     if (tex_out.a < 0.2) {
         discard;
     }
@@ -57,4 +107,7 @@ void main()
     vec3 specular = light_color * pow(max(0.0, dot(R, V)), material_properties.w) * material_properties.z;
 
     color = vec4(ambient + direct_light * (diffuse + specular), 1.0);
+
+    float brightness = dot(color.rgb, vec3(0.2126, 0.7152, 0.0722));
+    bright_color = brightness > bright_threshold ? color : vec4(0.0, 0.0, 0.0, 1.0);
 }
@@ -6,12 +6,13 @@ in vec2 vert_uv;
 
 uniform sampler2D screen_texture;
 uniform sampler2D bloom_texture;
+uniform float bloom_strength;
 
 void main()
 {
     const float exposure = 0.2;
     const float gamma = 2.2;
-    vec3 hdr = texture(screen_texture, vert_uv).rgb + texture(bloom_texture, vert_uv).rgb;
+    vec3 hdr = texture(screen_texture, vert_uv).rgb + texture(bloom_texture, vert_uv).rgb * bloom_strength;
 
     vec3 mapped = vec3(1.0) - exp(-hdr * exposure);
     // gamma correction
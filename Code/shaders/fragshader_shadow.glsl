@@ -2,10 +2,36 @@
 
 in vec2 vert_uv;
 
-uniform sampler2D material_diffuse;
+// Uniform blocks, laid out as in uniform_blocks.h
+layout (std140) uniform Pass {
+    mat4 view;
+    mat4 projection;
+    vec3 light_position;
+    vec3 light_color;
+    float time;
+};
+
+layout (std140) uniform Material {
+    vec4 material_properties;
+    float diffuse_layer;
+    float wave_mask_layer;
+    bool is_water;
+    float amplitude[6];
+    float frequency[6];
+    float phase[6];
+};
+
+layout (std140) uniform Draw {
+    // Decoding of quantized vertex formats, identity for float vertices
+    vec3 position_offset;
+    vec3 position_scale;
+    bool octahedral_normals;
+};
+
+uniform sampler2DArray material_diffuse;
 
 void main() {
-    vec4 tex_out = texture(material_diffuse, vert_uv);
+    vec4 tex_out = texture(material_diffuse, vec3(vert_uv, diffuse_layer));
     if (tex_out.a < 0.2) {
         discard;
     }
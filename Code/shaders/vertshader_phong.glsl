@@ -7,25 +7,38 @@
 layout (location = 0) in vec3 vert_coordinates_in;
 layout (location = 1) in vec3 vert_normal_in;
 layout (location = 2) in vec2 vert_uv_in;
-
-// Specify the Uniforms of the vertex shader
-uniform mat4x4 model, view, projection;
-
-uniform mat4x4 light_view, light_projection;
-
-uniform mat3x3 normal_matrix;
-
-uniform float[6] amplitude;
-uniform float[6] frequency;
-uniform float[6] phase;
-uniform float time;
-
-uniform bool is_water;
-
-uniform sampler2D wave_mask;
-
-// Light properties
-uniform vec3 light_position;
+// Advanced once per instance
+layout (location = 3) in mat4 model;
+layout (location = 7) in mat3 normal_matrix;
+layout (location = 10) in float instance_seed;
+
+// Uniform blocks, laid out as in uniform_blocks.h
+layout (std140) uniform Pass {
+    mat4 view;
+    mat4 projection;
+    vec3 light_position;
+    vec3 light_color;
+    float time;
+};
+
+layout (std140) uniform Material {
+    vec4 material_properties;
+    float diffuse_layer;
+    float wave_mask_layer;
+    bool is_water;
+    float amplitude[6];
+    float frequency[6];
+    float phase[6];
+};
+
+layout (std140) uniform Draw {
+    // Decoding of quantized vertex formats, identity for float vertices
+    vec3 position_offset;
+    vec3 position_scale;
+    bool octahedral_normals;
+};
+
+uniform sampler2DArray wave_mask;
 
 // Specify the output of the vertex stage
 out vec3 vert_position;
@@ -33,10 +46,11 @@ out vec3 vert_normal;
 out vec2 vert_uv;
 out float wave_height;
 out vec3 light_view_position;
-out vec4 light_space_frag_position;
+out vec3 vert_world_position;
 
 float waveHeight(int idx, float x) {
-    return amplitude[idx] * sin(2.0 * M_PI * frequency[idx] * x + phase[idx] + time);
+    float seed_phase = 2.0 * M_PI * instance_seed;
+    return amplitude[idx] * sin(2.0 * M_PI * frequency[idx] * x + phase[idx] + seed_phase + time);
 }
 
 float waveHeight2(int idx, vec2 uv) {
@@ -51,11 +65,24 @@ vec2 waveDeriv(int idx, vec2 uv) {
      return vec2(dx, dy);
 }
 
+vec3 decodeNormal(vec3 normal) {
+    if (!octahedral_normals) {
+        return normal;
+    }
+    vec2 e = normal.xy;
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 signs = vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(e.yx)) * signs;
+    }
+    return normalize(n);
+}
+
 void main()
 {
     wave_height = 0.0;
     vec2 deriv = vec2(0.0, 0.0);
-    float mask = texture(wave_mask, vert_uv_in).r;
+    float mask = texture(wave_mask, vec3(vert_uv_in, wave_mask_layer)).r;
     for (int i = 0; i < 3; ++i) {
         if (is_water) {
             wave_height += mask * waveHeight2(i, vert_uv_in);
@@ -65,10 +92,11 @@ void main()
         }
     }
 
-    vec3 world_position = vert_coordinates_in;
-    vert_normal = vert_normal_in;
+    vec3 world_position = position_offset + vert_coordinates_in * position_scale;
+    vec3 normal = decodeNormal(vert_normal_in);
+    vert_normal = normal;
     if (is_water) {
-        world_position += vert_normal_in * wave_height;
+        world_position += normal * wave_height;
         vert_normal = normalize(vec3(-deriv.x, 1.0, -deriv.y));
     } else {
         world_position += wave_height;
@@ -82,5 +110,5 @@ void main()
     vert_uv = vert_uv_in;
 
     light_view_position = vec3(view * vec4(light_position, 1.0));
-    light_space_frag_position = light_projection * light_view * model * vec4(world_position, 1.0);
+    vert_world_position = vec3(model * vec4(world_position, 1.0));
 }
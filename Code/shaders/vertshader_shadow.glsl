@@ -7,26 +7,48 @@
 layout (location = 0) in vec3 vert_coordinates_in;
 layout (location = 1) in vec3 vert_normal_in;
 layout (location = 2) in vec2 vert_uv_in;
-
-// Specify the Uniforms of the vertex shader
-uniform mat4x4 model, view, projection;
-
-uniform float[3] amplitude;
-uniform float[3] frequency;
-uniform float[3] phase;
-uniform float time;
-
-uniform sampler2D wave_mask;
+// Advanced once per instance
+layout (location = 3) in mat4 model;
+layout (location = 10) in float instance_seed;
+
+// Uniform blocks, laid out as in uniform_blocks.h
+layout (std140) uniform Pass {
+    mat4 view;
+    mat4 projection;
+    vec3 light_position;
+    vec3 light_color;
+    float time;
+};
+
+layout (std140) uniform Material {
+    vec4 material_properties;
+    float diffuse_layer;
+    float wave_mask_layer;
+    bool is_water;
+    float amplitude[6];
+    float frequency[6];
+    float phase[6];
+};
+
+layout (std140) uniform Draw {
+    // Decoding of quantized vertex formats, identity for float vertices
+    vec3 position_offset;
+    vec3 position_scale;
+    bool octahedral_normals;
+};
+
+uniform sampler2DArray wave_mask;
 
 out vec2 vert_uv;
 
 float waveHeight(int idx, float x) {
-    return amplitude[idx] * sin(2.0 * M_PI * frequency[idx] * x + phase[idx] + time);
+    float seed_phase = 2.0 * M_PI * instance_seed;
+    return amplitude[idx] * sin(2.0 * M_PI * frequency[idx] * x + phase[idx] + seed_phase + time);
 }
 
 void main() {
-    vec3 world_position = vert_coordinates_in;
-    float mask = texture(wave_mask, vert_uv_in).r;
+    vec3 world_position = position_offset + vert_coordinates_in * position_scale;
+    float mask = texture(wave_mask, vec3(vert_uv_in, wave_mask_layer)).r;
     for (int i = 0; i < 3; ++i) {
             world_position += mask * waveHeight(i, world_position.y);
     }
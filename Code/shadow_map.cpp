@@ -0,0 +1,243 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+
+#include "gl_state.h"
+#include "shadow_map.h"
+
+namespace {
+// As declared by the phong fragment shader
+constexpr std::size_t max_cascades = 4;
+// Blend of logarithmic and uniform splits of the view frustum, logarithmic
+// splits give each cascade the same texels per pixel but leave the far
+// cascades huge
+constexpr float split_blend = 0.75f;
+// Steps per cascade diameter its fit moves in. Between steps the cascade stays
+// put and its static depth remains valid, at the cost of a slightly larger
+// cascade that still covers its part of the frustum wherever it is snapped to.
+constexpr unsigned fit_steps = 16;
+
+// Size of a texel in the depth units of an orthographic cascade projection
+float texel_depth(const QMatrix4x4& projection, unsigned resolution) {
+  return std::abs(projection(2, 2)) / (projection(0, 0) * resolution);
+}
+} // namespace
+
+ShadowMap::ShadowMap(unsigned size,
+                     std::vector<ShadowCascadeSettings> settings,
+                     float shadow_distance)
+    : size(size), distance(shadow_distance) {
+  assert(!settings.empty() && settings.size() <= max_cascades);
+  initializeOpenGLFunctions();
+
+  for (auto cascade : settings) {
+    cascade.resolution = std::min(cascade.resolution, size);
+    cascade.update_interval = std::max(cascade.update_interval, 1);
+    Cascade entry;
+    entry.settings = cascade;
+    cascades.push_back(entry);
+  }
+
+  static_depth = create_depth_array();
+  depth = create_depth_array();
+  static_framebufs.reserve(cascades.size());
+  framebufs.reserve(cascades.size());
+  for (std::size_t i = 0; i < cascades.size(); ++i) {
+    Framebuffer static_framebuf, framebuf;
+    static_framebuf.attach_depth_layer(static_depth, i);
+    static_framebuf.finalize();
+    framebuf.attach_depth_layer(depth, i);
+    framebuf.finalize();
+    static_framebufs.push_back(std::move(static_framebuf));
+    framebufs.push_back(std::move(framebuf));
+  }
+}
+
+ShadowMap::~ShadowMap() {
+  auto& state = GLState::current();
+  state.deleted_texture(static_depth);
+  state.deleted_texture(depth);
+  glDeleteTextures(1, &static_depth);
+  glDeleteTextures(1, &depth);
+}
+
+void ShadowMap::draw(Scene& scene, ShaderInstance& shader,
+                     const QMatrix4x4& view, const QMatrix4x4& projection) {
+  QVector3D light_direction =
+      -QVector3D(scene.light.pos.x, scene.light.pos.y, scene.light.pos.z)
+           .normalized();
+
+  // Depth range of the camera, from its projection matrix
+  float camera_near = projection(2, 3) / (projection(2, 2) - 1.0f);
+  float camera_far = projection(2, 3) / (projection(2, 2) + 1.0f);
+  camera_far = std::min(camera_far, distance);
+
+  auto casters = static_casters(scene);
+  bool has_dynamic = std::any_of(
+      scene.meshes.begin(), scene.meshes.end(),
+      [](const MeshInstance& mesh) { return mesh.is_dynamic(); });
+
+  // Far cascades are redrawn less often, staggered so that they do not all
+  // fall on the same frame
+  auto lod = shader.lod_settings();
+  float near = camera_near;
+  for (std::size_t i = 0; i < cascades.size(); ++i) {
+    auto& cascade = cascades[i];
+    float fraction = float(i + 1) / cascades.size();
+    float log_split =
+        camera_near * std::pow(camera_far / camera_near, fraction);
+    float uniform_split = camera_near + (camera_far - camera_near) * fraction;
+    float far = split_blend * log_split + (1.0f - split_blend) * uniform_split;
+
+    if (!cascade.drawn ||
+        (frame + i) % cascade.settings.update_interval == 0) {
+      fit(cascade, near, far, view, projection, light_direction);
+      shader.set_lod_settings(
+          {float(cascade.settings.resolution), lod.max_pixel_error});
+      draw(i, scene, shader, casters, has_dynamic);
+    }
+    near = far;
+  }
+  shader.set_lod_settings(lod);
+  ++frame;
+}
+
+void ShadowMap::bind() {
+  GLState::current().bind_texture(GL_TEXTURE_2D_ARRAY, depth);
+}
+
+void ShadowMap::bind_uniforms(UniformRing& uniforms) const {
+  ShadowBlock block = {};
+  block.cascade_count = cascades.size();
+  // The shader's bias is tuned for the nearest cascade
+  auto nearest_texel = texel_depth(cascades[0].projection,
+                                   cascades[0].settings.resolution);
+  for (std::size_t i = 0; i < cascades.size(); ++i) {
+    const auto& cascade = cascades[i];
+    auto light_space = cascade.projection * cascade.view;
+    std::copy_n(light_space.constData(), 16, block.light_space[i]);
+    block.cascade_far[i].value = cascade.far;
+    block.cascade_scale[i].value = float(cascade.settings.resolution) / size;
+    block.cascade_bias_scale[i].value =
+        texel_depth(cascade.projection, cascade.settings.resolution) /
+        nearest_texel;
+  }
+
+  auto mapping = uniforms.map(sizeof(block));
+  if (!mapping.data) {
+    return;
+  }
+  std::memcpy(mapping.data, &block, sizeof(block));
+  uniforms.unmap();
+  uniforms.bind(shadow_binding, mapping.offset, sizeof(block));
+}
+
+void ShadowMap::fit(Cascade& cascade, float near, float far,
+                    const QMatrix4x4& view, const QMatrix4x4& projection,
+                    const QVector3D& light_direction) {
+  // The smallest sphere around the frustum slice lies on the view axis. Its
+  // radius does not change as the camera turns, which keeps the size of the
+  // cascade's texels constant.
+  float spread = 1.0f / (projection(0, 0) * projection(0, 0)) +
+                 1.0f / (projection(1, 1) * projection(1, 1));
+  float center_depth =
+      std::min(std::max((far + near) * (1.0f + spread) / 2.0f, near), far);
+  float radius = std::sqrt(far * far * spread +
+                           (far - center_depth) * (far - center_depth));
+  auto center = view.inverted().map(QVector3D(0.0f, 0.0f, -center_depth));
+
+  QVector3D up(0.0f, 1.0f, 0.0f);
+  if (std::abs(QVector3D::dotProduct(light_direction, up)) > 0.99f) {
+    up = QVector3D(0.0f, 0.0f, 1.0f);
+  }
+
+  // The center moves in steps of whole texels, which only shifts the shadows
+  // by whole texels. Rounding it to the nearest step moves it by at most half
+  // a step along each axis, so by half a step diagonal, by which the sphere
+  // grows.
+  auto resolution = cascade.settings.resolution;
+  auto step_texels = std::max(resolution / fit_steps, 1u);
+  radius /= 1.0f - std::sqrt(3.0f) * step_texels / resolution;
+  float step = 2.0f * radius / resolution * step_texels;
+
+  QMatrix4x4 rotation;
+  rotation.lookAt(QVector3D(), light_direction, up);
+  auto light_center = rotation.map(center);
+  light_center.setX(std::round(light_center.x() / step) * step);
+  light_center.setY(std::round(light_center.y() / step) * step);
+  light_center.setZ(std::round(light_center.z() / step) * step);
+  center = rotation.inverted().map(light_center);
+
+  // Meshes up to the shadow distance in front of the sphere still cast into it
+  cascade.view = QMatrix4x4();
+  cascade.view.lookAt(center - light_direction * (radius + distance), center,
+                      up);
+  cascade.projection = QMatrix4x4();
+  cascade.projection.ortho(-radius, radius, -radius, radius, 0.0f,
+                           2.0f * radius + distance);
+  cascade.far = far;
+}
+
+void ShadowMap::draw(std::size_t index, Scene& scene, ShaderInstance& shader,
+                     std::size_t casters, bool has_dynamic) {
+  auto& cascade = cascades[index];
+  auto resolution = cascade.settings.resolution;
+  GLState::current().viewport(0, 0, resolution, resolution);
+
+  if (casters != cascade.static_casters ||
+      cascade.view != cascade.static_view ||
+      cascade.projection != cascade.static_projection) {
+    static_framebufs[index].bind();
+    glClear(GL_DEPTH_BUFFER_BIT);
+    cascade.holds_static = false;
+    // A pass that did not fit into the uniform ring leaves the cache empty,
+    // the cascade is then redrawn the next frame
+    if (!shader.draw(scene, cascade.view, cascade.projection,
+                     MeshSelection::static_meshes)) {
+      cascade.static_casters = std::size_t(-1);
+      cascade.drawn = false;
+      return;
+    }
+    cascade.static_casters = casters;
+    cascade.static_view = cascade.view;
+    cascade.static_projection = cascade.projection;
+  }
+  cascade.drawn = true;
+
+  // Without dynamic meshes, the copy of the static depth is still current
+  if (!has_dynamic && cascade.holds_static) {
+    return;
+  }
+  static_framebufs[index].blit_depth(framebufs[index], resolution, resolution);
+  if (has_dynamic && !shader.draw(scene, cascade.view, cascade.projection,
+                                  MeshSelection::dynamic_meshes)) {
+    cascade.drawn = false;
+  }
+  cascade.holds_static = !has_dynamic;
+}
+
+GLuint ShadowMap::create_depth_array() {
+  GLuint handle;
+  glGenTextures(1, &handle);
+  GLState::current().bind_texture(GL_TEXTURE_2D_ARRAY, handle);
+  glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size,
+               cascades.size(), 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE,
+                  GL_COMPARE_REF_TO_TEXTURE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+  float border_color[] = {1.0f, 1.0f, 1.0f, 1.0f};
+  glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, border_color);
+  return handle;
+}
+
+std::size_t ShadowMap::static_casters(const Scene& scene) const {
+  return std::count_if(scene.meshes.begin(), scene.meshes.end(),
+                       [](const MeshInstance& mesh) {
+                         return !mesh.is_dynamic() &&
+                                mesh.material->is_resident();
+                       });
+}
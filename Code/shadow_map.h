@@ -0,0 +1,90 @@
+#ifndef SHADOW_MAP_H
+#define SHADOW_MAP_H
+
+#include <QMatrix4x4>
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <cstddef>
+#include <vector>
+
+#include "framebuffer.h"
+#include "scene.h"
+#include "shader.h"
+#include "uniform_ring.h"
+
+struct ShadowCascadeSettings {
+  // Texels along each side, at most the size of the shadow map
+  unsigned resolution;
+  // Frames between redraws of the cascade
+  int update_interval;
+};
+
+// Cascaded shadow maps of a directional light, shining from the light's
+// position towards the origin. The camera's view frustum up to the shadow
+// distance is split into one part per cascade, nearer cascades covering less
+// of the scene at the same or a higher resolution. The cascades are layers of
+// a depth texture array, those of a lower resolution use only part of their
+// layer.
+//
+// Each cascade caches the depth of meshes that never move in a second array,
+// which is only redrawn when the light, the cascade's fit or the set of
+// static meshes changes. Updates copy that depth and draw only the dynamic
+// meshes on top of it.
+class ShadowMap : protected QOpenGLFunctions_3_3_Core {
+public:
+  ShadowMap(unsigned size, std::vector<ShadowCascadeSettings> cascades,
+            float shadow_distance);
+  ~ShadowMap();
+
+  ShadowMap(const ShadowMap&) = delete;
+  ShadowMap& operator=(const ShadowMap&) = delete;
+
+  // Redraws the cascades that are due this frame, changing the viewport and
+  // the bound framebuffer
+  void draw(Scene& scene, ShaderInstance& shader, const QMatrix4x4& view,
+            const QMatrix4x4& projection);
+
+  // Binds the depth texture array holding all cascades
+  void bind();
+  // Binds the cascades' matrices and extents as the shadow uniform block
+  void bind_uniforms(UniformRing& uniforms) const;
+
+private:
+  struct Cascade {
+    ShadowCascadeSettings settings;
+    // Farthest view depth the cascade covers
+    float far = 0.0f;
+    // Light matrices of the last redraw
+    QMatrix4x4 view, projection;
+    bool drawn = false;
+
+    // What the static depth was drawn with
+    QMatrix4x4 static_view, static_projection;
+    std::size_t static_casters = std::size_t(-1);
+    // Whether the sampled layer holds exactly the static depth
+    bool holds_static = false;
+  };
+
+  // Fits a cascade around the part of the view frustum between two view
+  // depths, snapped to steps of whole texels so that its shadows do not
+  // flicker as the camera moves, and its static depth stays valid within a
+  // step
+  void fit(Cascade& cascade, float near, float far, const QMatrix4x4& view,
+           const QMatrix4x4& projection, const QVector3D& light_direction);
+  void draw(std::size_t index, Scene& scene, ShaderInstance& shader,
+            std::size_t casters, bool has_dynamic);
+  GLuint create_depth_array();
+  // Number of static meshes the cache would contain, which changes as meshes
+  // are loaded and their textures become resident
+  std::size_t static_casters(const Scene& scene) const;
+
+  unsigned size;
+  float distance;
+  std::vector<Cascade> cascades;
+  GLuint static_depth = 0, depth = 0;
+  // One of each per cascade, with its layer as the depth attachment
+  std::vector<Framebuffer> static_framebufs, framebufs;
+  unsigned frame = 0;
+};
+
+#endif // SHADOW_MAP_H
@@ -1,38 +1,10 @@
-﻿#include <QDebug>
-#include <QImage>
-
-#include <cstdint>
-#include <vector>
-
-#include "texture.h"
-
-std::vector<std::uint8_t> image_to_bytes(const QImage& image) {
-  // needed since (0,0) is bottom left in OpenGL
-  QImage im = image.mirrored();
-  std::vector<std::uint8_t> data;
-  data.reserve(im.width() * im.height() * 4);
-
-  for (int i = 0; i != im.height(); ++i) {
-    for (int j = 0; j != im.width(); ++j) {
-      QRgb pixel = im.pixel(j, i);
-
-      // pixel is of format #AARRGGBB (in hexadecimal notation)
-      // so with bitshifting and binary AND you can get
-      // the values of the different components
-      std::uint8_t r = (std::uint8_t)((pixel >> 16) & 0xFF); // Red component
-      std::uint8_t g = (std::uint8_t)((pixel >> 8) & 0xFF);  // Green component
-      std::uint8_t b = (std::uint8_t)(pixel & 0xFF);         // Blue component
-      std::uint8_t a = (std::uint8_t)((pixel >> 24) & 0xFF); // Alpha component
-
-      // Add them to the Vector
-      data.push_back(r);
-      data.push_back(g);
-      data.push_back(b);
-      data.push_back(a);
-    }
-  }
-  return data;
-}
+﻿#include "texture.h"
+
+#include <QOpenGLContext>
+
+#include <algorithm>
+
+#include "gl_state.h"
 
 Texture::Texture(unsigned width, unsigned height, GLuint format,
                  GLuint data_type, GLuint data_format, const uint8_t* data) {
@@ -51,11 +23,40 @@ Texture::Texture(unsigned width, unsigned height, GLuint format,
   }
 }
 
-Texture::~Texture() { glDeleteTextures(1, &handle); }
+Texture::Texture(const CompressedImage& image) {
+  initializeOpenGLFunctions();
+
+  glGenTextures(1, &handle);
+  bind();
+
+  auto format = static_cast<GLenum>(image.format);
+  unsigned width = image.width, height = image.height;
+  for (std::size_t level = 0; level < image.levels.size(); ++level) {
+    const auto& data = image.levels[level];
+    glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height, 0,
+                           data.size(), data.data());
+    width = std::max(width / 2, 1u);
+    height = std::max(height / 2, 1u);
+  }
+
+  // The mip chain comes with the file, so nothing is generated here
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL,
+                  static_cast<GLint>(image.levels.size()) - 1);
+  set_parameters();
+}
+
+Texture::~Texture() {
+  if (handle) {
+    GLState::current().deleted_texture(handle);
+  }
+  glDeleteTextures(1, &handle);
+}
 
 void Texture::swap(Texture&& other) { std::swap(handle, other.handle); }
 
-void Texture::bind() { glBindTexture(GL_TEXTURE_2D, handle); }
+void Texture::bind() {
+  GLState::current().bind_texture(GL_TEXTURE_2D, handle);
+}
 
 void Texture::set_parameters() {
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
@@ -69,12 +70,26 @@ void Texture::set_parameters() {
   glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, f);
 }
 
+bool Texture::supports_s3tc() {
+  auto* context = QOpenGLContext::currentContext();
+  return context &&
+         context->hasExtension("GL_EXT_texture_compression_s3tc") &&
+         (context->hasExtension("GL_EXT_texture_sRGB") ||
+          context->hasExtension("GL_EXT_texture_compression_s3tc_srgb"));
+}
+
 Texture Texture::from_file(const QString& path) {
-  QImage img(path);
-  if (img.isNull()) {
-    qDebug() << "Error loading texture:" << path;
+  return from_data(load_texture_data(path, supports_s3tc()));
+}
+
+Texture Texture::from_image(const Image& image) {
+  return Texture(image.width, image.height, GL_SRGB_ALPHA, GL_UNSIGNED_BYTE,
+                 GL_RGBA, image.pixels.data());
+}
+
+Texture Texture::from_data(const TextureData& data) {
+  if (data.is_compressed()) {
+    return Texture(data.compressed);
   }
-  auto pixels = image_to_bytes(img);
-  return Texture(img.width(), img.height(), GL_SRGB_ALPHA, GL_UNSIGNED_BYTE,
-                 GL_RGBA, pixels.data());
+  return from_image(data.image);
 }
@@ -7,6 +7,8 @@
 #include <cstdint>
 #include <vector>
 
+#include "image.h"
+#include "texture_data.h"
 #include "vertex.h"
 
 class Texture : protected QOpenGLFunctions_3_3_Core {
@@ -14,6 +16,8 @@ public:
   Texture(unsigned width, unsigned height, GLuint format,
           GLuint data_type = GL_UNSIGNED_BYTE, GLuint data_format = GL_RGBA,
           const uint8_t* data = nullptr);
+  // Uploads precompressed mip levels as they are
+  explicit Texture(const CompressedImage& image);
   ~Texture();
 
   void swap(Texture&& other);
@@ -34,7 +38,13 @@ public:
 
   GLuint gl_handle() { return handle; }
 
+  // Whether the current context can sample sRGB S3TC textures, which the
+  // BlockFormat values of BC1 and BC3 are
+  static bool supports_s3tc();
+
   static Texture from_file(const QString& path);
+  static Texture from_image(const Image& image);
+  static Texture from_data(const TextureData& data);
 
 private:
   void set_parameters();
@@ -0,0 +1,203 @@
+#include <algorithm>
+
+#include "gl_state.h"
+#include "texture_array.h"
+
+namespace {
+unsigned mip_count(unsigned width, unsigned height) {
+  unsigned levels = 1;
+  for (auto size = std::max(width, height); size > 1; size /= 2) {
+    ++levels;
+  }
+  return levels;
+}
+
+// Size of one layer of a mip level
+std::size_t level_size(const TextureLayout& layout, unsigned width,
+                       unsigned height) {
+  if (layout.compressed) {
+    return compressed_size(static_cast<BlockFormat>(layout.internal_format),
+                           width, height);
+  }
+  return std::size_t(width) * height * 4;
+}
+} // namespace
+
+TextureLayout texture_layout(const TextureData& data) {
+  TextureLayout layout;
+  if (data.is_compressed()) {
+    layout.internal_format = static_cast<GLenum>(data.compressed.format);
+    layout.width = data.compressed.width;
+    layout.height = data.compressed.height;
+    layout.levels = data.compressed.levels.size();
+    layout.compressed = true;
+  } else {
+    // Same as Texture::from_image, with the full mip chain generated
+    layout.internal_format = GL_SRGB8_ALPHA8;
+    layout.width = data.image.width;
+    layout.height = data.image.height;
+    layout.levels = mip_count(data.image.width, data.image.height);
+  }
+  return layout;
+}
+
+TextureArray::TextureArray(const TextureLayout& layout, int capacity)
+    : format(layout), requested(layout.levels) {
+  initializeOpenGLFunctions();
+  allocate(std::max(capacity, 1));
+}
+
+TextureArray::~TextureArray() {
+  if (handle) {
+    GLState::current().deleted_texture(handle);
+  }
+  glDeleteTextures(1, &handle);
+}
+
+int TextureArray::allocate_layer() {
+  if (free_layers.empty()) {
+    grow(layer_capacity * 2);
+  }
+  auto layer = free_layers.back();
+  free_layers.pop_back();
+  return layer;
+}
+
+void TextureArray::release(int layer) { free_layers.push_back(layer); }
+
+void TextureArray::bind() {
+  GLState::current().bind_texture(GL_TEXTURE_2D_ARRAY, handle);
+}
+
+std::size_t TextureArray::memory_size() const {
+  return memory_size(allocated_base);
+}
+
+std::size_t TextureArray::memory_size(unsigned from_level) const {
+  std::size_t size = 0;
+  for (unsigned level = from_level; level < format.levels; ++level) {
+    size += level_size(format, std::max(format.width >> level, 1u),
+                       std::max(format.height >> level, 1u));
+  }
+  return size * layer_capacity;
+}
+
+void TextureArray::allocate_levels(unsigned level) {
+  bind();
+  for (; allocated_base > level; --allocated_base) {
+    allocate_level(allocated_base - 1, layer_capacity);
+  }
+}
+
+void TextureArray::set_base_level(unsigned level) {
+  base = level;
+  bind();
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, base);
+}
+
+void TextureArray::drop_levels(unsigned level) {
+  set_base_level(std::max(base, level));
+  // Respecifying a level with no texels frees its memory, levels below the
+  // base level do not count towards completeness
+  for (; allocated_base < base; ++allocated_base) {
+    allocate_level(allocated_base, 0);
+  }
+}
+
+unsigned TextureArray::take_requested_level() {
+  auto level = requested;
+  requested = format.levels;
+  return level;
+}
+
+void TextureArray::allocate_level(unsigned level, int layers) {
+  unsigned width = layers > 0 ? std::max(format.width >> level, 1u) : 0;
+  unsigned height = layers > 0 ? std::max(format.height >> level, 1u) : 0;
+  if (format.compressed) {
+    glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, format.internal_format,
+                           width, height, layers, 0,
+                           level_size(format, width, height) * layers,
+                           nullptr);
+  } else {
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, level, format.internal_format, width,
+                 height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+  }
+}
+
+void TextureArray::allocate(int capacity) {
+  glGenTextures(1, &handle);
+  bind();
+
+  for (unsigned level = allocated_base; level < format.levels; ++level) {
+    allocate_level(level, capacity);
+  }
+
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, base);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL,
+                  static_cast<GLint>(format.levels) - 1);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER,
+                  GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+  glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+  GLfloat f;
+  glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &f);
+  glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, f);
+
+  // Hand out the lowest layers first
+  for (int layer = capacity - 1; layer >= layer_capacity; --layer) {
+    free_layers.push_back(layer);
+  }
+  layer_capacity = capacity;
+}
+
+void TextureArray::grow(int capacity) {
+  // OpenGL 3.3 cannot copy between textures directly, so the layers take a
+  // round trip through client memory. Doubling the capacity keeps this rare.
+  std::vector<std::vector<std::uint8_t>> levels(format.levels);
+  bind();
+  for (unsigned level = allocated_base; level < format.levels; ++level) {
+    levels[level].resize(level_size(format, std::max(format.width >> level, 1u),
+                                    std::max(format.height >> level, 1u)) *
+                         layer_capacity);
+    if (format.compressed) {
+      glGetCompressedTexImage(GL_TEXTURE_2D_ARRAY, level,
+                              levels[level].data());
+    } else {
+      glGetTexImage(GL_TEXTURE_2D_ARRAY, level, GL_RGBA, GL_UNSIGNED_BYTE,
+                    levels[level].data());
+    }
+  }
+
+  auto old_capacity = layer_capacity;
+  GLState::current().deleted_texture(handle);
+  glDeleteTextures(1, &handle);
+  allocate(capacity);
+
+  for (unsigned level = allocated_base; level < format.levels; ++level) {
+    const auto& data = levels[level];
+    auto width = std::max(format.width >> level, 1u);
+    auto height = std::max(format.height >> level, 1u);
+    if (format.compressed) {
+      glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, width,
+                                height, old_capacity, format.internal_format,
+                                data.size(), data.data());
+    } else {
+      glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, width, height,
+                      old_capacity, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+    }
+  }
+}
+
+TextureLayer::TextureLayer(std::shared_ptr<TextureArray> array, int layer,
+                           QString source)
+    : texture_array(std::move(array)), index(layer), path(std::move(source)) {
+  texture_array->used_layers.push_back(this);
+}
+
+TextureLayer::~TextureLayer() {
+  auto& layers = texture_array->used_layers;
+  layers.erase(std::find(layers.begin(), layers.end(), this));
+  texture_array->release(index);
+}
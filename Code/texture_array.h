@@ -0,0 +1,136 @@
+#ifndef TEXTURE_ARRAY_H
+#define TEXTURE_ARRAY_H
+
+#include <QOpenGLFunctions_3_3_Core>
+#include <QString>
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "texture_data.h"
+
+// Format, size and mip count shared by all layers of a texture array
+struct TextureLayout {
+  GLenum internal_format = 0;
+  unsigned width = 0, height = 0;
+  unsigned levels = 0;
+  bool compressed = false;
+
+  bool operator==(const TextureLayout& other) const {
+    return internal_format == other.internal_format &&
+           width == other.width && height == other.height &&
+           levels == other.levels && compressed == other.compressed;
+  }
+  bool operator!=(const TextureLayout& other) const {
+    return !(*this == other);
+  }
+};
+
+// Layout of the layer a texture would take once uploaded
+TextureLayout texture_layout(const TextureData& data);
+
+class TextureLayer;
+
+// A GL_TEXTURE_2D_ARRAY of material textures with the same layout, so that
+// meshes with different materials can be drawn without binding another
+// texture. Layers are allocated as textures are added, and the array grows
+// when it runs out of them.
+//
+// Fine mip levels need not be resident: only levels from the base level on
+// are sampled, and only levels from the allocated level on take memory. All
+// layers share these, as GL_TEXTURE_BASE_LEVEL applies to the whole array.
+class TextureArray : protected QOpenGLFunctions_3_3_Core {
+public:
+  explicit TextureArray(const TextureLayout& layout, int capacity = 1);
+  ~TextureArray();
+
+  TextureArray(const TextureArray&) = delete;
+  TextureArray& operator=(const TextureArray&) = delete;
+
+  // Returns the index of a free layer, growing the array if there is none.
+  // Its contents are undefined until something is uploaded into it.
+  int allocate_layer();
+  void release(int layer);
+
+  void bind();
+
+  GLuint gl_handle() { return handle; }
+  const TextureLayout& layout() const { return format; }
+  int capacity() const { return layer_capacity; }
+  // Layers in use
+  const std::vector<TextureLayer*>& layers() const { return used_layers; }
+
+  unsigned base_level() const { return base; }
+  unsigned allocated_level() const { return allocated_base; }
+  // Video memory taken by the allocated levels of all layers
+  std::size_t memory_size() const;
+  std::size_t memory_size(unsigned from_level) const;
+
+  // Allocates storage for the finer levels from level on, which are only
+  // sampled after set_base_level() once they have been uploaded
+  void allocate_levels(unsigned level);
+  void set_base_level(unsigned level);
+  // Stops sampling and frees all levels finer than level
+  void drop_levels(unsigned level);
+
+  // Notes the finest level that a mesh drawn with this array needs
+  void request_level(unsigned level) { requested = std::min(requested, level); }
+  // Finest level requested since the last call, or the level count if the
+  // array was not needed at all
+  unsigned take_requested_level();
+
+  // Uploads in flight into this array, its levels are not changed meanwhile
+  int pending_uploads() const { return uploads; }
+  void begin_upload() { ++uploads; }
+  void end_upload() { --uploads; }
+
+private:
+  friend class TextureLayer;
+
+  void allocate(int capacity);
+  // Specifies a level with storage for the given number of layers, none
+  // frees it
+  void allocate_level(unsigned level, int layers);
+  // Reallocates with more layers, copying the contents of the current ones
+  void grow(int capacity);
+
+  GLuint handle = 0;
+  TextureLayout format;
+  int layer_capacity = 0;
+  std::vector<int> free_layers;
+  std::vector<TextureLayer*> used_layers;
+  unsigned base = 0;
+  unsigned allocated_base = 0;
+  unsigned requested;
+  int uploads = 0;
+};
+
+// A layer of a texture array holding one texture, given back to the array
+// when the last material using it is gone. It is resident once its pixels
+// have been uploaded completely. Finer mip levels are read again from its
+// source file when they are needed.
+class TextureLayer : public std::enable_shared_from_this<TextureLayer> {
+public:
+  TextureLayer(std::shared_ptr<TextureArray> array, int layer, QString source);
+  ~TextureLayer();
+
+  TextureLayer(const TextureLayer&) = delete;
+  TextureLayer& operator=(const TextureLayer&) = delete;
+
+  TextureArray& array() const { return *texture_array; }
+  int layer() const { return index; }
+  const QString& source() const { return path; }
+
+  bool is_resident() const { return resident; }
+  void set_resident() { resident = true; }
+
+private:
+  std::shared_ptr<TextureArray> texture_array;
+  int index;
+  QString path;
+  bool resident = false;
+};
+
+#endif // TEXTURE_ARRAY_H
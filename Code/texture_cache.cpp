@@ -0,0 +1,187 @@
+#include <QDebug>
+
+#include <algorithm>
+
+#include "texture_cache.h"
+
+PendingTexture TextureCache::load(const QString& path) {
+  PendingTexture pending;
+  pending.path = path;
+
+  std::unique_lock<std::mutex> lock(mutex);
+  auto cached = by_path.constFind(path);
+  if (cached != by_path.constEnd()) {
+    pending.texture = hit(*cached);
+    if (pending.texture) {
+      return pending;
+    }
+  }
+
+  auto in_flight = loading.value(path);
+  if (in_flight) {
+    loaded.wait(lock, [&] { return in_flight->done; });
+    pending.data = in_flight->data;
+    return pending;
+  }
+
+  in_flight = std::make_shared<Loading>();
+  loading.insert(path, in_flight);
+  lock.unlock();
+
+  auto contents = load_texture_data(path, s3tc);
+  generate_mips(contents);
+  auto data = std::make_shared<const TextureData>(std::move(contents));
+
+  lock.lock();
+  in_flight->data = data;
+  in_flight->done = true;
+  loading.remove(path);
+  loaded.notify_all();
+
+  // A copy of the file under another path may be alive already, in which
+  // case the pixels just read are dropped right away
+  if (!data->content_hash.isEmpty()) {
+    auto same = by_content.constFind(data->content_hash);
+    if (same != by_content.constEnd()) {
+      pending.texture = hit(*same);
+      if (pending.texture) {
+        by_path.insert(path, *same);
+        return pending;
+      }
+    }
+  }
+  pending.data = data;
+  return pending;
+}
+
+std::shared_ptr<TextureLayer>
+TextureCache::get(const PendingTexture& pending) {
+  if (pending.texture) {
+    return pending.texture;
+  }
+  const auto& data = *pending.data;
+
+  std::shared_ptr<TextureArray> array;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Loads of the same file that were in flight together all end up here,
+    // only the first of them uploads it
+    auto cached = by_path.constFind(pending.path);
+    if (cached != by_path.constEnd()) {
+      if (auto texture = hit(*cached)) {
+        return texture;
+      }
+    }
+    if (!data.content_hash.isEmpty()) {
+      auto same = by_content.constFind(data.content_hash);
+      if (same != by_content.constEnd()) {
+        if (auto texture = hit(*same)) {
+          by_path.insert(pending.path, *same);
+          return texture;
+        }
+      }
+    }
+    ++counters.misses;
+    array = array_for(texture_layout(data));
+  }
+
+  // Only the GL thread uploads, so nobody can register this texture meanwhile
+  auto texture = std::make_shared<TextureLayer>(
+      array, array->allocate_layer(), pending.path);
+  // Only the levels the array holds at the moment are uploaded, finer ones
+  // stream in later if they are needed
+  auto layer = texture.get();
+  uploader.upload(texture, pending.data, array->allocated_level(),
+                  [layer] { layer->set_resident(); });
+  Entry entry{texture, texture_size(data)};
+
+  std::lock_guard<std::mutex> lock(mutex);
+  evict_unused_locked();
+  by_path.insert(pending.path, entry);
+  if (!data.content_hash.isEmpty()) {
+    by_content.insert(data.content_hash, entry);
+  }
+  return texture;
+}
+
+void TextureCache::evict_unused() {
+  std::lock_guard<std::mutex> lock(mutex);
+  evict_unused_locked();
+}
+
+TextureCache::Stats TextureCache::stats() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  auto current = counters;
+  current.arrays = std::count_if(arrays.begin(), arrays.end(),
+                                 [](const std::weak_ptr<TextureArray>& array) {
+                                   return !array.expired();
+                                 });
+  return current;
+}
+
+std::vector<std::shared_ptr<TextureArray>> TextureCache::live_arrays() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::vector<std::shared_ptr<TextureArray>> live;
+  for (const auto& array : arrays) {
+    if (auto shared = array.lock()) {
+      live.push_back(std::move(shared));
+    }
+  }
+  return live;
+}
+
+void TextureCache::log_stats() const {
+  auto current = stats();
+  qDebug() << ":: Texture cache:" << current.hits << "hits," << current.misses
+           << "misses," << current.evictions << "evictions,"
+           << current.bytes_saved / 1024.0 << "KB saved by sharing,"
+           << current.arrays << "texture arrays";
+}
+
+std::shared_ptr<TextureLayer> TextureCache::hit(const Entry& entry) {
+  auto texture = entry.texture.lock();
+  if (texture) {
+    ++counters.hits;
+    counters.bytes_saved += entry.size;
+  }
+  return texture;
+}
+
+void TextureCache::evict_unused_locked() {
+  for (auto it = by_path.begin(); it != by_path.end();) {
+    if (it->texture.expired()) {
+      it = by_path.erase(it);
+      ++counters.evictions;
+    } else {
+      ++it;
+    }
+  }
+  for (auto it = by_content.begin(); it != by_content.end();) {
+    if (it->texture.expired()) {
+      it = by_content.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+std::shared_ptr<TextureArray>
+TextureCache::array_for(const TextureLayout& layout) {
+  if (pack_layers) {
+    for (const auto& array : arrays) {
+      auto shared = array.lock();
+      if (shared && shared->layout() == layout) {
+        return shared;
+      }
+    }
+  }
+
+  arrays.erase(std::remove_if(arrays.begin(), arrays.end(),
+                              [](const std::weak_ptr<TextureArray>& array) {
+                                return array.expired();
+                              }),
+               arrays.end());
+  auto array = std::make_shared<TextureArray>(layout);
+  arrays.push_back(array);
+  return array;
+}
@@ -0,0 +1,117 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QtGlobal>
+
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "texture_array.h"
+#include "texture_data.h"
+#include "texture_uploader.h"
+
+// A texture on its way through the cache: either one that was already
+// uploaded, or its pixels waiting to be uploaded on the GL thread
+struct PendingTexture {
+  QString path;
+  std::shared_ptr<TextureLayer> texture;
+  std::shared_ptr<const TextureData> data;
+};
+
+// Shares textures between all materials that use them. Textures are found by
+// path, and by the hash of their contents so that copies of a file under
+// another name are uploaded once. The cache only holds weak references: a
+// texture is deleted as soon as the last material using it is, and its
+// entries are evicted on the next lookup.
+//
+// Textures are streamed into layers of texture arrays, and cannot be drawn
+// with until they are resident. When packing, textures
+// of the same format and size share an array, so that drawing meshes with
+// different materials does not rebind textures. Otherwise each texture gets
+// an array of its own.
+class TextureCache {
+public:
+  struct Stats {
+    int hits = 0;
+    int misses = 0;
+    int evictions = 0;
+    // Video memory that uploading every hit separately would have taken
+    qint64 bytes_saved = 0;
+    // Texture arrays in use
+    int arrays = 0;
+  };
+
+  explicit TextureCache(bool pack_layers = true) : pack_layers(pack_layers) {}
+  TextureCache(const TextureCache&) = delete;
+  TextureCache& operator=(const TextureCache&) = delete;
+
+  // Whether precompressed textures in an S3TC format are read, which the GL
+  // context must support, see Texture::supports_s3tc. Off until set, which
+  // must happen before the first load.
+  void set_s3tc(bool enabled) { s3tc = enabled; }
+  bool reads_s3tc() const { return s3tc; }
+
+  // Returns the texture for path if it is alive, and reads its pixels with
+  // their full mip chain otherwise. Concurrent loads of the same path wait
+  // for a single read. Safe to call from any thread.
+  PendingTexture load(const QString& path);
+
+  // Returns the texture loaded by load(), queueing its upload unless an
+  // identical one is alive by now. Must be called on the GL thread.
+  std::shared_ptr<TextureLayer> get(const PendingTexture& pending);
+
+  // Uploads queued textures under a budget of bytes per call, see
+  // TextureUploader::update. Must be called on the GL thread.
+  std::size_t stream_uploads(std::size_t budget_bytes) {
+    return uploader.update(budget_bytes);
+  }
+  bool is_uploading() const { return !uploader.idle(); }
+  TextureUploader& uploads() { return uploader; }
+
+  // Texture arrays with at least one layer in use
+  std::vector<std::shared_ptr<TextureArray>> live_arrays() const;
+
+  // Drops the entries of textures that are no longer referenced
+  void evict_unused();
+
+  Stats stats() const;
+  void log_stats() const;
+
+private:
+  struct Entry {
+    std::weak_ptr<TextureLayer> texture;
+    std::size_t size = 0;
+  };
+
+  struct Loading {
+    std::shared_ptr<const TextureData> data;
+    bool done = false;
+  };
+
+  // Returns the texture of entry if it is alive, counting it as a hit
+  std::shared_ptr<TextureLayer> hit(const Entry& entry);
+  void evict_unused_locked();
+  // Array to add a texture of the given layout to, with the mutex held
+  std::shared_ptr<TextureArray> array_for(const TextureLayout& layout);
+
+  mutable std::mutex mutex;
+  std::condition_variable loaded;
+  QHash<QString, Entry> by_path;
+  QHash<QByteArray, Entry> by_content;
+  // Reads in flight, so that their path is read only once
+  QHash<QString, std::shared_ptr<Loading>> loading;
+  bool pack_layers;
+  bool s3tc = false;
+  // Arrays live as long as one of their layers is used
+  std::vector<std::weak_ptr<TextureArray>> arrays;
+  Stats counters;
+  TextureUploader uploader;
+};
+
+#endif // TEXTURE_CACHE_H
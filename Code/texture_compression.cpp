@@ -0,0 +1,435 @@
+#include <QDebug>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include "texture_compression.h"
+
+namespace {
+float srgb_to_linear(float value) {
+  return value <= 0.04045f ? value / 12.92f
+                           : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+float linear_to_srgb(float value) {
+  return value <= 0.0031308f ? value * 12.92f
+                             : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+}
+
+std::uint8_t to_unorm8(float value) {
+  return static_cast<std::uint8_t>(
+      std::lround(std::max(0.0f, std::min(1.0f, value)) * 255.0f));
+}
+
+// Texels of a mip level as floats, in the space they are filtered in
+struct Plane {
+  unsigned width = 0, height = 0;
+  int channels = 0;
+  std::vector<float> texels;
+
+  float* at(unsigned x, unsigned y) {
+    return &texels[(std::size_t(y) * width + x) * channels];
+  }
+};
+
+// Linear values of all 8-bit sRGB values
+const std::array<float, 256>& srgb_table() {
+  static const auto table = [] {
+    std::array<float, 256> values;
+    for (int i = 0; i < 256; ++i) {
+      values[i] = srgb_to_linear(i / 255.0f);
+    }
+    return values;
+  }();
+  return table;
+}
+
+Plane to_plane(const Image& image, TextureKind kind) {
+  const auto& srgb = srgb_table();
+  Plane plane;
+  plane.width = image.width;
+  plane.height = image.height;
+  plane.channels =
+      kind == TextureKind::Color ? 4 : kind == TextureKind::Mask ? 1 : 3;
+  auto count = std::size_t(image.width) * image.height;
+  plane.texels.resize(count * plane.channels);
+  for (std::size_t i = 0; i < count; ++i) {
+    const auto* in = &image.pixels[i * 4];
+    auto* out = &plane.texels[i * plane.channels];
+    switch (kind) {
+    case TextureKind::Color:
+      out[0] = srgb[in[0]];
+      out[1] = srgb[in[1]];
+      out[2] = srgb[in[2]];
+      out[3] = in[3] / 255.0f;
+      break;
+    case TextureKind::Mask:
+      out[0] = srgb[in[0]];
+      break;
+    case TextureKind::Normal:
+      out[0] = in[0] / 127.5f - 1.0f;
+      out[1] = in[1] / 127.5f - 1.0f;
+      out[2] = in[2] / 127.5f - 1.0f;
+      break;
+    }
+  }
+  return plane;
+}
+
+// Halves both dimensions with a box filter
+Plane downsample(Plane& plane, TextureKind kind) {
+  Plane half;
+  half.width = std::max(plane.width / 2, 1u);
+  half.height = std::max(plane.height / 2, 1u);
+  half.channels = plane.channels;
+  half.texels.resize(std::size_t(half.width) * half.height * half.channels);
+  for (unsigned y = 0; y < half.height; ++y) {
+    for (unsigned x = 0; x < half.width; ++x) {
+      unsigned x0 = std::min(x * 2, plane.width - 1);
+      unsigned x1 = std::min(x * 2 + 1, plane.width - 1);
+      unsigned y0 = std::min(y * 2, plane.height - 1);
+      unsigned y1 = std::min(y * 2 + 1, plane.height - 1);
+      auto* out = half.at(x, y);
+      for (int c = 0; c < plane.channels; ++c) {
+        out[c] = (plane.at(x0, y0)[c] + plane.at(x1, y0)[c] +
+                  plane.at(x0, y1)[c] + plane.at(x1, y1)[c]) /
+                 4.0f;
+      }
+      if (kind == TextureKind::Normal) {
+        auto length =
+            std::sqrt(out[0] * out[0] + out[1] * out[1] + out[2] * out[2]);
+        if (length > 0.0f) {
+          out[0] /= length;
+          out[1] /= length;
+          out[2] /= length;
+        }
+      }
+    }
+  }
+  return half;
+}
+
+// The bytes stored per texel: RGBA for colors, one value for masks, X and Y
+// for normals
+std::vector<std::uint8_t> quantize(Plane& plane, TextureKind kind) {
+  auto count = std::size_t(plane.width) * plane.height;
+  int out_channels =
+      kind == TextureKind::Color ? 4 : kind == TextureKind::Mask ? 1 : 2;
+  std::vector<std::uint8_t> bytes(count * out_channels);
+  for (std::size_t i = 0; i < count; ++i) {
+    const auto* in = &plane.texels[i * plane.channels];
+    auto* out = &bytes[i * out_channels];
+    switch (kind) {
+    case TextureKind::Color:
+      out[0] = to_unorm8(linear_to_srgb(in[0]));
+      out[1] = to_unorm8(linear_to_srgb(in[1]));
+      out[2] = to_unorm8(linear_to_srgb(in[2]));
+      out[3] = to_unorm8(in[3]);
+      break;
+    case TextureKind::Mask:
+      out[0] = to_unorm8(in[0]);
+      break;
+    case TextureKind::Normal:
+      out[0] = to_unorm8(in[0] * 0.5f + 0.5f);
+      out[1] = to_unorm8(in[1] * 0.5f + 0.5f);
+      break;
+    }
+  }
+  return bytes;
+}
+
+// Copies the 4x4 block at (bx, by) out of a level, repeating the last row and
+// column for levels smaller than a block
+void gather_block(const std::vector<std::uint8_t>& bytes, unsigned width,
+                  unsigned height, int channels, unsigned bx, unsigned by,
+                  int channel, std::uint8_t* out, int out_stride) {
+  for (unsigned y = 0; y < 4; ++y) {
+    for (unsigned x = 0; x < 4; ++x) {
+      auto sx = std::min(bx * 4 + x, width - 1);
+      auto sy = std::min(by * 4 + y, height - 1);
+      const auto* texel = &bytes[(std::size_t(sy) * width + sx) * channels];
+      auto* dst = out + (y * 4 + x) * out_stride;
+      if (channel < 0) {
+        std::memcpy(dst, texel, channels);
+      } else {
+        *dst = texel[channel];
+      }
+    }
+  }
+}
+
+std::vector<std::uint8_t> encode_level(const std::vector<std::uint8_t>& bytes,
+                                       unsigned width, unsigned height,
+                                       BlockFormat format) {
+  std::vector<std::uint8_t> blocks(compressed_size(format, width, height));
+  auto block_size = block_bytes(format);
+  unsigned blocks_x = (width + 3) / 4, blocks_y = (height + 3) / 4;
+  for (unsigned by = 0; by < blocks_y; ++by) {
+    for (unsigned bx = 0; bx < blocks_x; ++bx) {
+      auto* out = &blocks[(std::size_t(by) * blocks_x + bx) * block_size];
+      std::uint8_t rgba[64], values[16];
+      switch (format) {
+      case BlockFormat::BC1:
+        gather_block(bytes, width, height, 4, bx, by, -1, rgba, 4);
+        encode_bc1_block(rgba, out);
+        break;
+      case BlockFormat::BC3:
+        gather_block(bytes, width, height, 4, bx, by, -1, rgba, 4);
+        gather_block(bytes, width, height, 4, bx, by, 3, values, 1);
+        encode_bc4_block(values, out);
+        encode_bc1_block(rgba, out + 8);
+        break;
+      case BlockFormat::BC4:
+        gather_block(bytes, width, height, 1, bx, by, 0, values, 1);
+        encode_bc4_block(values, out);
+        break;
+      case BlockFormat::BC5:
+        gather_block(bytes, width, height, 2, bx, by, 0, values, 1);
+        encode_bc4_block(values, out);
+        gather_block(bytes, width, height, 2, bx, by, 1, values, 1);
+        encode_bc4_block(values, out + 8);
+        break;
+      }
+    }
+  }
+  return blocks;
+}
+
+struct Color {
+  float r, g, b;
+};
+
+unsigned quantize_bits(float value, float max) {
+  value = std::max(0.0f, std::min(255.0f, value));
+  return static_cast<unsigned>(std::lround(value * max / 255.0f));
+}
+
+std::uint16_t to_rgb565(const Color& c) {
+  return static_cast<std::uint16_t>((quantize_bits(c.r, 31.0f) << 11) |
+                                    (quantize_bits(c.g, 63.0f) << 5) |
+                                    quantize_bits(c.b, 31.0f));
+}
+
+Color from_rgb565(std::uint16_t packed) {
+  unsigned r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+  return Color{float((r << 3) | (r >> 2)), float((g << 2) | (g >> 4)),
+               float((b << 3) | (b >> 2))};
+}
+
+float distance_squared(const Color& a, const std::uint8_t* b) {
+  float dr = a.r - b[0], dg = a.g - b[1], db = a.b - b[2];
+  return dr * dr + dg * dg + db * db;
+}
+
+// Picks the closest of the four palette entries for every texel, returning
+// the total squared error
+float fit_bc1_indices(const std::uint8_t rgba[64], std::uint16_t c0,
+                      std::uint16_t c1, std::uint8_t indices[16]) {
+  auto a = from_rgb565(c0), b = from_rgb565(c1);
+  Color palette[4] = {
+      a, b,
+      Color{(2 * a.r + b.r) / 3, (2 * a.g + b.g) / 3, (2 * a.b + b.b) / 3},
+      Color{(a.r + 2 * b.r) / 3, (a.g + 2 * b.g) / 3, (a.b + 2 * b.b) / 3}};
+  float total = 0.0f;
+  for (int i = 0; i < 16; ++i) {
+    float best = distance_squared(palette[0], &rgba[i * 4]);
+    indices[i] = 0;
+    for (std::uint8_t p = 1; p < 4; ++p) {
+      float d = distance_squared(palette[p], &rgba[i * 4]);
+      if (d < best) {
+        best = d;
+        indices[i] = p;
+      }
+    }
+    total += best;
+  }
+  return total;
+}
+
+// Orders the endpoints for the four color mode, which requires c0 > c1
+void order_endpoints(std::uint16_t& c0, std::uint16_t& c1) {
+  if (c0 < c1) {
+    std::swap(c0, c1);
+  }
+}
+
+void write_bc1(std::uint16_t c0, std::uint16_t c1,
+               const std::uint8_t indices[16], std::uint8_t out[8]) {
+  std::uint32_t bits = 0;
+  for (int i = 0; i < 16; ++i) {
+    bits |= std::uint32_t(c0 == c1 ? 0 : indices[i]) << (i * 2);
+  }
+  out[0] = c0 & 0xff;
+  out[1] = c0 >> 8;
+  out[2] = c1 & 0xff;
+  out[3] = c1 >> 8;
+  out[4] = bits & 0xff;
+  out[5] = (bits >> 8) & 0xff;
+  out[6] = (bits >> 16) & 0xff;
+  out[7] = bits >> 24;
+}
+
+// Endpoints minimizing the squared error for fixed indices
+bool refine_endpoints(const std::uint8_t rgba[64],
+                      const std::uint8_t indices[16], Color& a, Color& b) {
+  static const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+  float aa = 0, ab = 0, bb = 0;
+  Color ax{0, 0, 0}, bx{0, 0, 0};
+  for (int i = 0; i < 16; ++i) {
+    float alpha = weights[indices[i]], beta = 1.0f - alpha;
+    const auto* texel = &rgba[i * 4];
+    aa += alpha * alpha;
+    ab += alpha * beta;
+    bb += beta * beta;
+    ax.r += alpha * texel[0], ax.g += alpha * texel[1], ax.b += alpha * texel[2];
+    bx.r += beta * texel[0], bx.g += beta * texel[1], bx.b += beta * texel[2];
+  }
+  float det = aa * bb - ab * ab;
+  if (std::abs(det) < 1e-6f) {
+    return false;
+  }
+  float inv = 1.0f / det;
+  a = Color{(ax.r * bb - bx.r * ab) * inv, (ax.g * bb - bx.g * ab) * inv,
+            (ax.b * bb - bx.b * ab) * inv};
+  b = Color{(bx.r * aa - ax.r * ab) * inv, (bx.g * aa - ax.g * ab) * inv,
+            (bx.b * aa - ax.b * ab) * inv};
+  return true;
+}
+} // namespace
+
+void encode_bc1_block(const std::uint8_t rgba[64], std::uint8_t out[8]) {
+  // Endpoints start at the extremes along the principal axis of the colors
+  Color mean{0, 0, 0};
+  for (int i = 0; i < 16; ++i) {
+    mean.r += rgba[i * 4] / 16.0f;
+    mean.g += rgba[i * 4 + 1] / 16.0f;
+    mean.b += rgba[i * 4 + 2] / 16.0f;
+  }
+  float cov[6] = {0, 0, 0, 0, 0, 0};
+  for (int i = 0; i < 16; ++i) {
+    float r = rgba[i * 4] - mean.r, g = rgba[i * 4 + 1] - mean.g,
+          b = rgba[i * 4 + 2] - mean.b;
+    cov[0] += r * r, cov[1] += r * g, cov[2] += r * b;
+    cov[3] += g * g, cov[4] += g * b, cov[5] += b * b;
+  }
+  Color axis{1.0f, 1.0f, 1.0f};
+  for (int iteration = 0; iteration < 8; ++iteration) {
+    Color next{cov[0] * axis.r + cov[1] * axis.g + cov[2] * axis.b,
+               cov[1] * axis.r + cov[3] * axis.g + cov[4] * axis.b,
+               cov[2] * axis.r + cov[4] * axis.g + cov[5] * axis.b};
+    float length = std::max({std::abs(next.r), std::abs(next.g),
+                             std::abs(next.b)});
+    if (length == 0.0f) {
+      break;
+    }
+    axis = Color{next.r / length, next.g / length, next.b / length};
+  }
+
+  float min_t = 0.0f, max_t = 0.0f;
+  for (int i = 0; i < 16; ++i) {
+    float t = (rgba[i * 4] - mean.r) * axis.r +
+              (rgba[i * 4 + 1] - mean.g) * axis.g +
+              (rgba[i * 4 + 2] - mean.b) * axis.b;
+    min_t = std::min(min_t, t);
+    max_t = std::max(max_t, t);
+  }
+  float axis_length_squared =
+      axis.r * axis.r + axis.g * axis.g + axis.b * axis.b;
+  if (axis_length_squared > 0.0f) {
+    min_t /= axis_length_squared;
+    max_t /= axis_length_squared;
+  }
+  Color a{mean.r + axis.r * max_t, mean.g + axis.g * max_t,
+          mean.b + axis.b * max_t};
+  Color b{mean.r + axis.r * min_t, mean.g + axis.g * min_t,
+          mean.b + axis.b * min_t};
+
+  auto c0 = to_rgb565(a), c1 = to_rgb565(b);
+  order_endpoints(c0, c1);
+  std::uint8_t indices[16];
+  float error = fit_bc1_indices(rgba, c0, c1, indices);
+
+  // One least squares pass over the chosen indices
+  if (c0 != c1 && refine_endpoints(rgba, indices, a, b)) {
+    auto r0 = to_rgb565(a), r1 = to_rgb565(b);
+    order_endpoints(r0, r1);
+    std::uint8_t refined[16];
+    float refined_error = fit_bc1_indices(rgba, r0, r1, refined);
+    if (refined_error < error) {
+      c0 = r0, c1 = r1;
+      std::memcpy(indices, refined, sizeof(indices));
+    }
+  }
+
+  write_bc1(c0, c1, indices, out);
+}
+
+void encode_bc4_block(const std::uint8_t values[16], std::uint8_t out[8]) {
+  auto range = std::minmax_element(values, values + 16);
+  int r0 = *range.second, r1 = *range.first;
+
+  std::uint64_t bits = 0;
+  if (r0 != r1) {
+    // Eight value mode: r0, r1 and six values in between
+    int palette[8] = {r0, r1};
+    for (int i = 1; i < 7; ++i) {
+      palette[i + 1] = ((7 - i) * r0 + i * r1 + 3) / 7;
+    }
+    for (int i = 0; i < 16; ++i) {
+      int best = 0, best_distance = 256;
+      for (int p = 0; p < 8; ++p) {
+        int distance = std::abs(palette[p] - values[i]);
+        if (distance < best_distance) {
+          best = p;
+          best_distance = distance;
+        }
+      }
+      bits |= std::uint64_t(best) << (i * 3);
+    }
+  }
+
+  out[0] = static_cast<std::uint8_t>(r0);
+  out[1] = static_cast<std::uint8_t>(r1);
+  for (int i = 0; i < 6; ++i) {
+    out[2 + i] = static_cast<std::uint8_t>(bits >> (i * 8));
+  }
+}
+
+CompressedImage compress_image(const Image& image, TextureKind kind) {
+  CompressedImage compressed;
+  compressed.width = image.width;
+  compressed.height = image.height;
+  if (image.width == 0 || image.height == 0) {
+    return compressed;
+  }
+
+  switch (kind) {
+  case TextureKind::Color: {
+    bool opaque = true;
+    for (std::size_t i = 3; i < image.pixels.size(); i += 4) {
+      opaque = opaque && image.pixels[i] == 255;
+    }
+    compressed.format = opaque ? BlockFormat::BC1 : BlockFormat::BC3;
+    break;
+  }
+  case TextureKind::Mask:
+    compressed.format = BlockFormat::BC4;
+    break;
+  case TextureKind::Normal:
+    compressed.format = BlockFormat::BC5;
+    break;
+  }
+
+  auto plane = to_plane(image, kind);
+  for (;;) {
+    compressed.levels.push_back(encode_level(
+        quantize(plane, kind), plane.width, plane.height, compressed.format));
+    if (plane.width == 1 && plane.height == 1) {
+      break;
+    }
+    plane = downsample(plane, kind);
+  }
+  return compressed;
+}
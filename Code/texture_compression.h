@@ -0,0 +1,28 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#include <cstdint>
+
+#include "image.h"
+#include "texture_data.h"
+
+// What a texture holds, which decides its block compression
+enum class TextureKind {
+  // sRGB color, BC1 when fully opaque and BC3 otherwise
+  Color,
+  // Single channel read from red, BC4. Values are converted from sRGB to
+  // linear, as sampling the uncompressed sRGB texture did.
+  Mask,
+  // Tangent-space normal map, BC5 holding X and Y. Shaders reconstruct Z.
+  Normal,
+};
+
+// Encodes the image along with a full mip chain, which is filtered in linear
+// space for colors and renormalized for normals
+CompressedImage compress_image(const Image& image, TextureKind kind);
+
+// Encoders of single blocks, taking 4x4 texels in row order
+void encode_bc1_block(const std::uint8_t rgba[64], std::uint8_t out[8]);
+void encode_bc4_block(const std::uint8_t values[16], std::uint8_t out[8]);
+
+#endif // TEXTURE_COMPRESSION_H
@@ -0,0 +1,266 @@
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cstring>
+
+#include "mapped_file.h"
+#include "texture_data.h"
+
+namespace {
+const std::uint8_t ktx_identifier[12] = {0xAB, 'K',  'T',  'X', ' ',  '1',
+                                         '1',  0xBB, '\r', '\n', 0x1A, '\n'};
+constexpr quint32 ktx_endianness = 0x04030201;
+
+struct KtxHeader {
+  std::uint8_t identifier[12];
+  quint32 endianness;
+  quint32 gl_type;
+  quint32 gl_type_size;
+  quint32 gl_format;
+  quint32 gl_internal_format;
+  quint32 gl_base_internal_format;
+  quint32 pixel_width;
+  quint32 pixel_height;
+  quint32 pixel_depth;
+  quint32 number_of_array_elements;
+  quint32 number_of_faces;
+  quint32 number_of_mipmap_levels;
+  quint32 bytes_of_key_value_data;
+};
+
+static_assert(sizeof(KtxHeader) == 64, "KTX header must be 64 bytes");
+
+bool is_block_format(quint32 value) {
+  switch (static_cast<BlockFormat>(value)) {
+  case BlockFormat::BC1:
+  case BlockFormat::BC3:
+  case BlockFormat::BC4:
+  case BlockFormat::BC5:
+    return true;
+  }
+  return false;
+}
+
+bool is_ktx_file(const char* data, qint64 size) {
+  return size >= static_cast<qint64>(sizeof(ktx_identifier)) &&
+         std::memcmp(data, ktx_identifier, sizeof(ktx_identifier)) == 0;
+}
+
+QByteArray hash_contents(const MappedFile& contents) {
+  auto bytes = QByteArray::fromRawData(contents.data(),
+                                       static_cast<int>(contents.size()));
+  return QCryptographicHash::hash(bytes, QCryptographicHash::Sha1);
+}
+} // namespace
+
+std::size_t block_bytes(BlockFormat format) {
+  return format == BlockFormat::BC1 || format == BlockFormat::BC4 ? 8 : 16;
+}
+
+bool is_s3tc(BlockFormat format) {
+  return format == BlockFormat::BC1 || format == BlockFormat::BC3;
+}
+
+quint32 base_internal_format(BlockFormat format) {
+  switch (format) {
+  case BlockFormat::BC1:
+    return 0x1907; // GL_RGB
+  case BlockFormat::BC3:
+    return 0x1908; // GL_RGBA
+  case BlockFormat::BC4:
+    return 0x1903; // GL_RED
+  case BlockFormat::BC5:
+    return 0x8227; // GL_RG
+  }
+  return 0;
+}
+
+std::size_t compressed_size(BlockFormat format, unsigned width,
+                            unsigned height) {
+  return std::size_t((width + 3) / 4) * ((height + 3) / 4) *
+         block_bytes(format);
+}
+
+std::size_t texture_size(const TextureData& texture) {
+  if (texture.is_compressed()) {
+    std::size_t size = 0;
+    for (const auto& level : texture.compressed.levels) {
+      size += level.size();
+    }
+    return size;
+  }
+  // A generated mip chain adds a third to the base level
+  return texture.image.pixels.size() * 4 / 3;
+}
+
+unsigned level_count(const TextureData& texture) {
+  if (texture.is_compressed()) {
+    return texture.compressed.levels.size();
+  }
+  return 1 + texture.mips.size();
+}
+
+void generate_mips(TextureData& texture) {
+  if (texture.is_compressed() || !texture.mips.empty()) {
+    return;
+  }
+  const auto* level = &texture.image;
+  while (level->width > 1 || level->height > 1) {
+    texture.mips.push_back(downsample_image(*level));
+    level = &texture.mips.back();
+  }
+}
+
+TextureData load_texture_data(const QString& path, bool s3tc) {
+  TextureData texture;
+
+  auto ktx_path = find_ktx_texture(path);
+  if (!ktx_path.isEmpty()) {
+    QFile file(ktx_path);
+    if (file.open(QIODevice::ReadOnly)) {
+      MappedFile contents(file);
+      if (read_ktx_file(contents.data(), contents.size(), texture.compressed)) {
+        if (s3tc || !is_s3tc(texture.compressed.format)) {
+          qDebug() << ":: Loading compressed texture:" << ktx_path;
+          texture.content_hash = hash_contents(contents);
+          return texture;
+        }
+        qDebug() << ":: Skipping S3TC texture without driver support:"
+                 << ktx_path;
+      }
+    }
+    texture.compressed = CompressedImage();
+    // Without an image to fall back to
+    if (ktx_path == path) {
+      qDebug() << "Error loading texture:" << path;
+      return texture;
+    }
+  }
+
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) {
+    qDebug() << "Error loading texture:" << path << file.errorString();
+    return texture;
+  }
+  MappedFile contents(file);
+  texture.image = decode_image(contents.data(), contents.size());
+  texture.content_hash = hash_contents(contents);
+  return texture;
+}
+
+bool read_ktx_file(const char* data, qint64 size, CompressedImage& image) {
+  if (!is_ktx_file(data, size) ||
+      size < static_cast<qint64>(sizeof(KtxHeader))) {
+    qDebug() << "Not a KTX file";
+    return false;
+  }
+
+  KtxHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (header.endianness != ktx_endianness) {
+    qDebug() << "KTX file has the wrong byte order";
+    return false;
+  }
+  if (header.gl_type != 0 || !is_block_format(header.gl_internal_format) ||
+      header.pixel_depth > 1 || header.number_of_array_elements != 0 ||
+      header.number_of_faces != 1 || header.pixel_width == 0 ||
+      header.pixel_height == 0) {
+    qDebug() << "Unsupported KTX texture, format"
+             << header.gl_internal_format;
+    return false;
+  }
+
+  image.format = static_cast<BlockFormat>(header.gl_internal_format);
+  image.width = header.pixel_width;
+  image.height = header.pixel_height;
+  image.levels.clear();
+
+  auto level_count = std::max<quint32>(header.number_of_mipmap_levels, 1);
+  qint64 offset = sizeof(KtxHeader) + header.bytes_of_key_value_data;
+  unsigned width = image.width, height = image.height;
+  for (quint32 level = 0; level < level_count; ++level) {
+    quint32 level_size = 0;
+    if (offset + qint64(sizeof(level_size)) > size) {
+      qDebug() << "Truncated KTX file";
+      return false;
+    }
+    std::memcpy(&level_size, data + offset, sizeof(level_size));
+    offset += sizeof(level_size);
+    if (level_size != compressed_size(image.format, width, height) ||
+        offset + level_size > size) {
+      qDebug() << "Invalid KTX mip level" << level;
+      return false;
+    }
+
+    auto level_data = reinterpret_cast<const std::uint8_t*>(data + offset);
+    image.levels.emplace_back(level_data, level_data + level_size);
+    // Levels are padded to a multiple of 4 bytes
+    offset += (level_size + 3) & ~quint32(3);
+
+    width = std::max(width / 2, 1u);
+    height = std::max(height / 2, 1u);
+  }
+  return true;
+}
+
+bool write_ktx_file(const QString& filename, const CompressedImage& image) {
+  KtxHeader header;
+  std::memcpy(header.identifier, ktx_identifier, sizeof(ktx_identifier));
+  header.endianness = ktx_endianness;
+  header.gl_type = 0;
+  header.gl_type_size = 1;
+  header.gl_format = 0;
+  header.gl_internal_format = static_cast<quint32>(image.format);
+  header.gl_base_internal_format = base_internal_format(image.format);
+  header.pixel_width = image.width;
+  header.pixel_height = image.height;
+  header.pixel_depth = 0;
+  header.number_of_array_elements = 0;
+  header.number_of_faces = 1;
+  header.number_of_mipmap_levels = image.levels.size();
+  header.bytes_of_key_value_data = 0;
+
+  QFile file(filename);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    qDebug() << "Error opening" << filename << "for writing:"
+             << file.errorString();
+    return false;
+  }
+  if (file.write(reinterpret_cast<const char*>(&header), sizeof(header)) !=
+      sizeof(header)) {
+    return false;
+  }
+  // Block sizes are multiples of 4 bytes, so levels never need padding
+  for (const auto& level : image.levels) {
+    auto level_size = static_cast<quint32>(level.size());
+    if (file.write(reinterpret_cast<const char*>(&level_size),
+                   sizeof(level_size)) != sizeof(level_size) ||
+        file.write(reinterpret_cast<const char*>(level.data()), level_size) !=
+            level_size) {
+      return false;
+    }
+  }
+  return true;
+}
+
+QString ktx_texture_path(const QString& image_filename) {
+  QFileInfo info(image_filename);
+  return info.path() + "/" + info.completeBaseName() + ".ktx";
+}
+
+QString find_ktx_texture(const QString& path) {
+  for (const auto& candidate : {path, ktx_texture_path(path)}) {
+    QFile file(candidate);
+    if (!file.open(QIODevice::ReadOnly)) {
+      continue;
+    }
+    auto identifier = file.peek(sizeof(ktx_identifier));
+    if (is_ktx_file(identifier.constData(), identifier.size())) {
+      return candidate;
+    }
+  }
+  return QString();
+}
@@ -0,0 +1,87 @@
+#ifndef TEXTURE_DATA_H
+#define TEXTURE_DATA_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "image.h"
+
+// Block compressions of precompressed textures, with the values of their
+// OpenGL internal formats
+enum class BlockFormat : quint32 {
+  BC1 = 0x8C4C, // GL_COMPRESSED_SRGB_S3TC_DXT1_EXT, opaque sRGB color
+  BC3 = 0x8C4F, // GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT, sRGB color and alpha
+  BC4 = 0x8DBB, // GL_COMPRESSED_RED_RGTC1, single channel
+  BC5 = 0x8DBD, // GL_COMPRESSED_RG_RGTC2, two channels
+};
+
+// Size of one encoded 4x4 block
+std::size_t block_bytes(BlockFormat format);
+
+// OpenGL base internal format (GL_RGB, GL_RGBA, ...) of a block format
+quint32 base_internal_format(BlockFormat format);
+
+// Size of a mip level of the given dimensions once block compressed
+std::size_t compressed_size(BlockFormat format, unsigned width,
+                            unsigned height);
+
+// Block compressed pixels with their full mip chain, bottom row first
+struct CompressedImage {
+  BlockFormat format = BlockFormat::BC1;
+  unsigned width = 0, height = 0;
+  // Mip levels from the largest to the smallest
+  std::vector<std::vector<std::uint8_t>> levels;
+};
+
+// Pixels of a texture, either decoded from an image file or precompressed
+struct TextureData {
+  Image image;
+  // Mip levels of image below the full size, see generate_mips()
+  std::vector<Image> mips;
+  CompressedImage compressed;
+  // SHA-1 of the file the pixels were read from, so that identical files
+  // under different paths can share a texture
+  QByteArray content_hash;
+
+  bool is_compressed() const { return !compressed.levels.empty(); }
+};
+
+// Video memory taken by the texture once uploaded, including its mip chain
+std::size_t texture_size(const TextureData& texture);
+
+// Number of mip levels the texture data holds
+unsigned level_count(const TextureData& texture);
+
+// Fills in the mip chain of an uncompressed image down to 1x1, so that any
+// range of levels can be uploaded. Compressed textures come with theirs.
+void generate_mips(TextureData& texture);
+
+// Whether a block format is one of the S3TC ones, which unlike the RGTC ones
+// are not core in OpenGL 3.3
+bool is_s3tc(BlockFormat format);
+
+// Reads the precompressed KTX texture for path if there is one, and decodes
+// path as an image otherwise. KTX files in an S3TC format are only read when
+// s3tc is set, and skipped for the image otherwise. Either way the file is
+// read only once, and hashed along the way.
+TextureData load_texture_data(const QString& path, bool s3tc);
+
+// Reads a KTX 1.1 file holding one of the block formats above, copying the
+// mip levels out of the given bytes
+bool read_ktx_file(const char* data, qint64 size, CompressedImage& image);
+
+bool write_ktx_file(const QString& filename, const CompressedImage& image);
+
+// Path of the precompressed texture next to the given image file
+QString ktx_texture_path(const QString& image_filename);
+
+// Returns path if it is a KTX file, else the KTX file next to it if that
+// exists, else an empty string
+QString find_ktx_texture(const QString& path);
+
+#endif // TEXTURE_DATA_H
@@ -0,0 +1,147 @@
+#include <QDebug>
+
+#include <algorithm>
+
+#include "texture_streamer.h"
+
+TextureStreamer::TextureStreamer(TextureCache& cache, AssetLoader& loader,
+                                 std::size_t memory_budget)
+    : cache(cache), loader(loader), budget(memory_budget) {}
+
+void TextureStreamer::update() {
+  // Arrays whose layers all have their finer levels now start sampling them.
+  // That includes layers added while streaming, which are uploaded from the
+  // allocated level on, so the array waits for all of its uploads. After a
+  // failure some of those levels hold no texels, so they are freed again and
+  // the array keeps sampling the levels it did.
+  for (auto it = streaming.begin(); it != streaming.end();) {
+    auto& stream = **it;
+    if (stream.remaining_reads > 0 || stream.array->pending_uploads() > 0) {
+      ++it;
+      continue;
+    }
+    if (stream.failed) {
+      stream.array->drop_levels(stream.array->base_level());
+      failed.push_back(stream.array);
+    } else {
+      stream.array->set_base_level(
+          std::min(stream.array->base_level(), stream.level));
+    }
+    it = streaming.erase(it);
+  }
+  failed.erase(std::remove_if(failed.begin(), failed.end(),
+                              [](const std::weak_ptr<TextureArray>& array) {
+                                return array.expired();
+                              }),
+               failed.end());
+
+  struct Change {
+    std::shared_ptr<TextureArray> array;
+    unsigned level;
+    // Memory the change takes or frees
+    std::size_t size;
+  };
+  std::vector<Change> finer, coarser;
+
+  resident = 0;
+  for (auto& array : cache.live_arrays()) {
+    resident += array->memory_size();
+
+    auto coarsest = array->layout().levels - 1;
+    auto needed = std::min(array->take_requested_level(), coarsest);
+    // Levels only change while nothing is uploaded into the array
+    if (is_streaming(*array) || array->pending_uploads() > 0) {
+      continue;
+    }
+    if (needed < array->allocated_level() && !has_failed(*array)) {
+      finer.push_back(
+          {array, needed, array->memory_size(needed) - array->memory_size()});
+    } else if (needed > array->allocated_level()) {
+      coarser.push_back(
+          {array, needed, array->memory_size() - array->memory_size(needed)});
+    }
+  }
+
+  // Under memory pressure, drop what nobody needs, largest savings first
+  std::sort(coarser.begin(), coarser.end(),
+            [](const Change& a, const Change& b) { return a.size > b.size; });
+  for (const auto& change : coarser) {
+    if (resident <= budget) {
+      break;
+    }
+    qDebug() << ":: Dropping texture levels below" << change.level << "of a"
+             << change.array->layout().width << "x"
+             << change.array->layout().height << "array";
+    change.array->drop_levels(change.level);
+    resident -= change.size;
+  }
+
+  // Stream in what fits, cheapest first so that the most textures sharpen
+  std::sort(finer.begin(), finer.end(),
+            [](const Change& a, const Change& b) { return a.size < b.size; });
+  for (const auto& change : finer) {
+    if (resident + change.size > budget) {
+      break;
+    }
+    stream_in(change.array, change.level);
+    resident += change.size;
+  }
+}
+
+void TextureStreamer::stream_in(const std::shared_ptr<TextureArray>& array,
+                                unsigned level) {
+  if (array->layers().empty()) {
+    return;
+  }
+  qDebug() << ":: Streaming in texture levels from" << level << "of a"
+           << array->layout().width << "x" << array->layout().height
+           << "array";
+
+  // The new levels take memory right away, but are not sampled until all
+  // layers have been uploaded into them
+  array->allocate_levels(level);
+
+  auto stream = std::make_shared<StreamIn>();
+  stream->array = array;
+  stream->level = level;
+  stream->remaining_reads = array->layers().size();
+  streaming.push_back(stream);
+
+  auto& uploads = cache.uploads();
+  auto s3tc = cache.reads_s3tc();
+  for (auto layer : array->layers()) {
+    auto shared_layer = layer->shared_from_this();
+    auto path = layer->source();
+    loader.load(
+        [path, s3tc] {
+          auto data = load_texture_data(path, s3tc);
+          generate_mips(data);
+          return std::make_shared<const TextureData>(std::move(data));
+        },
+        [&uploads, stream,
+         shared_layer](std::shared_ptr<const TextureData>& data) {
+          // The file may have failed to load or changed since
+          --stream->remaining_reads;
+          if (texture_layout(*data) != stream->array->layout()) {
+            qDebug() << "Error streaming in texture:" << shared_layer->source();
+            stream->failed = true;
+            return;
+          }
+          uploads.upload(shared_layer, data, stream->level, nullptr);
+        });
+  }
+}
+
+bool TextureStreamer::has_failed(const TextureArray& array) const {
+  return std::any_of(failed.begin(), failed.end(),
+                     [&](const std::weak_ptr<TextureArray>& failure) {
+                       return failure.lock().get() == &array;
+                     });
+}
+
+bool TextureStreamer::is_streaming(const TextureArray& array) const {
+  return std::any_of(streaming.begin(), streaming.end(),
+                     [&](const std::shared_ptr<StreamIn>& stream) {
+                       return stream->array.get() == &array;
+                     });
+}
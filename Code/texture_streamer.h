@@ -0,0 +1,54 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "asset_loader.h"
+#include "texture_array.h"
+#include "texture_cache.h"
+
+// Keeps only the mip levels of material textures resident that the meshes on
+// screen need. Passes with mip feedback request levels from the arrays they
+// draw with. Missing finer levels are then read again from the source files
+// in the background and uploaded, after which the arrays start sampling them.
+// Levels finer than needed are dropped when the arrays take up more memory
+// than the budget.
+class TextureStreamer {
+public:
+  TextureStreamer(TextureCache& cache, AssetLoader& loader,
+                  std::size_t memory_budget);
+
+  // Acts on the levels requested while drawing the frame, call once per frame
+  // after drawing
+  void update();
+
+  // Video memory taken by all texture arrays as of the last update
+  std::size_t resident_bytes() const { return resident; }
+
+private:
+  // Finer levels being read and uploaded for all layers of an array
+  struct StreamIn {
+    std::shared_ptr<TextureArray> array;
+    unsigned level;
+    // Layers whose source files are still being read again
+    int remaining_reads;
+    // Whether a layer could not be read again, or no longer matches the array
+    bool failed = false;
+  };
+
+  void stream_in(const std::shared_ptr<TextureArray>& array, unsigned level);
+  bool is_streaming(const TextureArray& array) const;
+  bool has_failed(const TextureArray& array) const;
+
+  TextureCache& cache;
+  AssetLoader& loader;
+  std::size_t budget;
+  std::size_t resident = 0;
+  std::vector<std::shared_ptr<StreamIn>> streaming;
+  // Arrays whose finer levels failed to stream in, which are not tried again
+  std::vector<std::weak_ptr<TextureArray>> failed;
+};
+
+#endif // TEXTURE_STREAMER_H
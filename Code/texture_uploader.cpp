@@ -0,0 +1,256 @@
+#include <QDebug>
+
+#include <algorithm>
+#include <cstring>
+
+#include "texture_uploader.h"
+
+namespace {
+// Largest unit a row can be split into, a block of BC3 or BC5
+constexpr std::size_t max_unit_size = 16;
+
+// Rows as they are staged: single pixel rows, or rows of 4x4 blocks. Rows
+// split across regions are split between units, pixels or blocks.
+struct LevelRows {
+  unsigned width, height;
+  unsigned count;
+  unsigned pixel_height;
+  std::size_t size;
+  unsigned units;
+  std::size_t unit_size;
+  const std::uint8_t* data;
+};
+
+LevelRows level_rows(const TextureData& data, unsigned level) {
+  LevelRows rows;
+  if (!data.is_compressed()) {
+    const auto& image = level == 0 ? data.image : data.mips[level - 1];
+    rows.width = image.width;
+    rows.height = image.height;
+    rows.count = image.height;
+    rows.pixel_height = 1;
+    rows.size = std::size_t(image.width) * 4;
+    rows.units = image.width;
+    rows.unit_size = 4;
+    rows.data = image.pixels.data();
+    return rows;
+  }
+
+  const auto& image = data.compressed;
+  rows.width = std::max(image.width >> level, 1u);
+  rows.height = std::max(image.height >> level, 1u);
+  rows.count = (rows.height + 3) / 4;
+  rows.pixel_height = 4;
+  rows.size = compressed_size(image.format, rows.width, 4);
+  rows.units = (rows.width + 3) / 4;
+  rows.unit_size = block_bytes(image.format);
+  rows.data = image.levels[level].data();
+  return rows;
+}
+} // namespace
+
+TextureUploader::TextureUploader(std::size_t buffer_size, int buffer_count)
+    : buffer_size(std::max(buffer_size, max_unit_size)),
+      buffers(std::max(buffer_count, 1)) {}
+
+TextureUploader::~TextureUploader() {
+  if (!initialized) {
+    return;
+  }
+  for (auto& buffer : buffers) {
+    if (buffer.fence) {
+      glDeleteSync(buffer.fence);
+    }
+    glDeleteBuffers(1, &buffer.handle);
+  }
+}
+
+void TextureUploader::upload(std::shared_ptr<TextureLayer> layer,
+                             std::shared_ptr<const TextureData> data,
+                             unsigned first_level,
+                             std::function<void()> done) {
+  if (first_level >= level_count(*data) ||
+      level_rows(*data, first_level).size == 0) {
+    // Nothing to upload, such as an image that failed to load
+    if (done) {
+      done();
+    }
+    return;
+  }
+  layer->array().begin_upload();
+  Job job;
+  job.layer = std::move(layer);
+  job.data = std::move(data);
+  job.done = std::move(done);
+  job.level = first_level;
+  queue.push_back(std::move(job));
+}
+
+std::size_t TextureUploader::update(std::size_t budget_bytes) {
+  if (queue.empty()) {
+    return 0;
+  }
+  initialize();
+
+  std::size_t staged = 0;
+  std::vector<Region> regions;
+  while (!queue.empty() && (staged == 0 || staged < budget_bytes)) {
+    auto& buffer = buffers[next_buffer];
+    if (buffer.fence) {
+      // Never wait for the GPU here, the uploads resume next frame instead
+      if (glClientWaitSync(buffer.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+        break;
+      }
+      glDeleteSync(buffer.fence);
+      buffer.fence = nullptr;
+    }
+
+    // The fence guarantees the GPU is done with the buffer, so its old
+    // contents are discarded without synchronizing
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.handle);
+    auto staging = static_cast<std::uint8_t*>(glMapBufferRange(
+        GL_PIXEL_UNPACK_BUFFER, 0, buffer_size,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+            GL_MAP_UNSYNCHRONIZED_BIT));
+    if (!staging) {
+      qDebug() << "Failed to map a texture staging buffer";
+      break;
+    }
+
+    regions.clear();
+    std::size_t offset = 0;
+    while (!queue.empty()) {
+      // The budget is only exceeded by the first row of a frame
+      auto capacity = buffer_size - offset;
+      if (staged > 0) {
+        capacity = std::min(capacity, budget_bytes - std::min(budget_bytes,
+                                                              staged));
+      }
+
+      Region region;
+      if (!stage(queue.front(), staging + offset, capacity, region)) {
+        break;
+      }
+      region.offset = offset;
+      offset += region.size;
+      staged += region.size;
+      if (region.last) {
+        queue.pop_front();
+      }
+      regions.push_back(std::move(region));
+    }
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+    for (const auto& region : regions) {
+      issue(region);
+    }
+    buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    next_buffer = (next_buffer + 1) % buffers.size();
+
+    if (regions.empty()) {
+      break;
+    }
+  }
+
+  // Leave client memory uploads (such as growing texture arrays) unaffected
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  return staged;
+}
+
+void TextureUploader::initialize() {
+  if (initialized) {
+    return;
+  }
+  initializeOpenGLFunctions();
+  for (auto& buffer : buffers) {
+    glGenBuffers(1, &buffer.handle);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.handle);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, buffer_size, nullptr,
+                 GL_STREAM_DRAW);
+  }
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+  initialized = true;
+}
+
+bool TextureUploader::stage(Job& job, std::uint8_t* staging,
+                            std::size_t capacity, Region& region) {
+  auto rows = level_rows(*job.data, job.level);
+  region.layer = job.layer;
+  region.level = job.level;
+  region.y = job.row * rows.pixel_height;
+
+  if (job.column > 0 || rows.size > buffer_size) {
+    // Part of a single row, with the units of a row stored one after another
+    auto count = std::min<std::size_t>(rows.units - job.column,
+                                       capacity / rows.unit_size);
+    if (count == 0) {
+      return false;
+    }
+    // Blocks are as wide as they are high
+    auto unit_width = rows.pixel_height;
+    region.x = job.column * unit_width;
+    region.width = std::min<unsigned>(count * unit_width,
+                                      rows.width - region.x);
+    region.height = std::min(rows.pixel_height, rows.height - region.y);
+    region.size = count * rows.unit_size;
+    std::memcpy(staging,
+                rows.data + job.row * rows.size + job.column * rows.unit_size,
+                region.size);
+
+    job.column += count;
+    if (job.column < rows.units) {
+      region.last = false;
+      return true;
+    }
+    job.column = 0;
+    ++job.row;
+  } else {
+    auto count = std::min<std::size_t>(rows.count - job.row,
+                                       capacity / rows.size);
+    if (count == 0) {
+      return false;
+    }
+    region.x = 0;
+    region.width = rows.width;
+    region.height = std::min<unsigned>(count * rows.pixel_height,
+                                       rows.height - region.y);
+    region.size = count * rows.size;
+    std::memcpy(staging, rows.data + job.row * rows.size, region.size);
+    job.row += count;
+  }
+
+  if (job.row == rows.count) {
+    job.row = 0;
+    ++job.level;
+  }
+  region.last = job.level == level_count(*job.data);
+  if (region.last) {
+    region.done = std::move(job.done);
+  }
+  return true;
+}
+
+void TextureUploader::issue(const Region& region) {
+  auto& array = region.layer->array();
+  const auto& layout = array.layout();
+  auto offset = reinterpret_cast<const void*>(region.offset);
+
+  array.bind();
+  if (layout.compressed) {
+    glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, region.level, region.x,
+                              region.y, region.layer->layer(), region.width,
+                              region.height, 1, layout.internal_format,
+                              region.size, offset);
+  } else {
+    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, region.level, region.x, region.y,
+                    region.layer->layer(), region.width, region.height, 1,
+                    GL_RGBA, GL_UNSIGNED_BYTE, offset);
+  }
+
+  if (region.last) {
+    array.end_upload();
+    if (region.done) {
+      region.done();
+    }
+  }
+}
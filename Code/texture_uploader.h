@@ -0,0 +1,92 @@
+#ifndef TEXTURE_UPLOADER_H
+#define TEXTURE_UPLOADER_H
+
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "texture_array.h"
+#include "texture_data.h"
+
+// Streams textures to the GPU through a ring of pixel buffer objects. Pixels
+// are copied into a staging buffer and uploaded from there, so the driver
+// transfers them asynchronously instead of stalling the GL thread. A fence
+// after each batch tells when the GPU is done reading a staging buffer, which
+// is only reused then. Large textures are spread across frames, a few rows at
+// a time, under a budget of bytes per frame. Rows larger than a staging buffer
+// are split into several regions.
+class TextureUploader : protected QOpenGLFunctions_3_3_Core {
+public:
+  // Staging buffers are created on the first update, with a current context
+  explicit TextureUploader(std::size_t buffer_size = 4 << 20,
+                           int buffer_count = 3);
+  ~TextureUploader();
+
+  TextureUploader(const TextureUploader&) = delete;
+  TextureUploader& operator=(const TextureUploader&) = delete;
+
+  // Queues uploading the mip levels from first_level on of data into layer,
+  // and calls done once they are all uploaded. Data must hold all levels of
+  // the layer's array.
+  void upload(std::shared_ptr<TextureLayer> layer,
+              std::shared_ptr<const TextureData> data, unsigned first_level,
+              std::function<void()> done);
+
+  // Stages queued uploads until budget_bytes were copied or no staging buffer
+  // is free, and returns the number of bytes staged. At least one row, or
+  // one buffer of it, is staged if a buffer is free, so that uploads always
+  // progress.
+  std::size_t update(std::size_t budget_bytes);
+
+  bool idle() const { return queue.empty(); }
+
+private:
+  struct Job {
+    std::shared_ptr<TextureLayer> layer;
+    std::shared_ptr<const TextureData> data;
+    std::function<void()> done;
+    // Mip level and row (of blocks, for compressed textures) to stage next,
+    // and the pixel or block to continue at in rows that are split
+    unsigned level = 0;
+    unsigned row = 0;
+    unsigned column = 0;
+  };
+
+  // A range of rows of a mip level, or part of a row, staged at an offset in
+  // a staging buffer
+  struct Region {
+    std::shared_ptr<TextureLayer> layer;
+    unsigned level, x, y, width, height;
+    std::size_t offset, size;
+    // Whether this is the last region of its upload, which carries its
+    // callback
+    bool last;
+    std::function<void()> done;
+  };
+
+  struct StagingBuffer {
+    GLuint handle = 0;
+    GLsync fence = nullptr;
+  };
+
+  void initialize();
+  // Copies the next rows of job that fit in capacity bytes to staging, and
+  // describes them in region. Rows larger than a staging buffer are copied
+  // in parts. Returns false if not even one row, or part of one, fits.
+  bool stage(Job& job, std::uint8_t* staging, std::size_t capacity,
+             Region& region);
+  void issue(const Region& region);
+
+  std::size_t buffer_size;
+  std::vector<StagingBuffer> buffers;
+  std::size_t next_buffer = 0;
+  bool initialized = false;
+  std::deque<Job> queue;
+};
+
+#endif // TEXTURE_UPLOADER_H
@@ -0,0 +1,38 @@
+# Offline asset compiler, converting source assets into the binary formats
+# loaded by Isolation at startup
+
+QT       += core gui
+
+TARGET = assetc
+TEMPLATE = app
+
+CONFIG += c++14 console
+CONFIG -= app_bundle
+
+INCLUDEPATH += ../..
+
+SOURCES += \
+    main.cpp \
+    ../../image.cpp \
+    ../../mapped_file.cpp \
+    ../../memory_usage.cpp \
+    ../../mesh_data.cpp \
+    ../../mesh_optimizer.cpp \
+    ../../mesh_simplifier.cpp \
+    ../../model.cpp \
+    ../../obj_parser.cpp \
+    ../../texture_compression.cpp \
+    ../../texture_data.cpp
+
+HEADERS += \
+    ../../image.h \
+    ../../mapped_file.h \
+    ../../memory_usage.h \
+    ../../mesh_data.h \
+    ../../mesh_optimizer.h \
+    ../../mesh_simplifier.h \
+    ../../model.h \
+    ../../obj_parser.h \
+    ../../texture_compression.h \
+    ../../texture_data.h \
+    ../../vertex.h
@@ -0,0 +1,265 @@
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QImage>
+#include <QStringList>
+#include <QTextStream>
+
+#include <algorithm>
+
+#include "image.h"
+#include "memory_usage.h"
+#include "mesh_data.h"
+#include "model.h"
+#include "texture_compression.h"
+#include "texture_data.h"
+
+namespace {
+constexpr int bench_repetitions = 5;
+
+void print_usage() {
+  QTextStream(stderr) << "Usage:\n"
+                      << "  assetc mesh <input.obj> [output.mesh]\n"
+                      << "  assetc texture <color|mask|normal> <input.png> "
+                         "[output.ktx]\n"
+                      << "  assetc bench-obj <input.obj>...\n"
+                      << "  assetc bench-load <input.obj>...\n"
+                      << "  assetc bench-image <image>...\n";
+}
+
+void silent_message_handler(QtMsgType, const QMessageLogContext&,
+                            const QString&) {}
+
+int compile_mesh(const QStringList& args) {
+  if (args.isEmpty() || args.size() > 2) {
+    print_usage();
+    return 1;
+  }
+  const auto& input = args[0];
+  auto output = args.size() > 1 ? args[1] : binary_mesh_path(input);
+
+  auto mesh = load_obj(input);
+  if (mesh.vertices.empty()) {
+    QTextStream(stderr) << "No geometry loaded from " << input << "\n";
+    return 1;
+  }
+  if (!write_mesh_file(output, mesh)) {
+    QTextStream(stderr) << "Failed to write " << output << "\n";
+    return 1;
+  }
+  auto triangles = mesh.lods.empty() ? mesh.indices.size() / 3
+                                     : mesh.lods.front().index_count / 3;
+  QTextStream(stdout) << input << " -> " << output << ": "
+                      << mesh.vertices.size() << " vertices, " << triangles
+                      << " triangles, " << mesh.lods.size() << " LODs\n";
+  return 0;
+}
+
+int compile_texture(const QStringList& args) {
+  if (args.size() < 2 || args.size() > 3) {
+    print_usage();
+    return 1;
+  }
+  TextureKind kind;
+  if (args[0] == "color") {
+    kind = TextureKind::Color;
+  } else if (args[0] == "mask") {
+    kind = TextureKind::Mask;
+  } else if (args[0] == "normal") {
+    kind = TextureKind::Normal;
+  } else {
+    print_usage();
+    return 1;
+  }
+  const auto& input = args[1];
+  auto output = args.size() > 2 ? args[2] : ktx_texture_path(input);
+
+  auto image = load_image(input);
+  if (image.pixels.empty()) {
+    QTextStream(stderr) << "Failed to load " << input << "\n";
+    return 1;
+  }
+  auto compressed = compress_image(image, kind);
+  if (!write_ktx_file(output, compressed)) {
+    QTextStream(stderr) << "Failed to write " << output << "\n";
+    return 1;
+  }
+
+  std::size_t compressed_bytes = 0;
+  for (const auto& level : compressed.levels) {
+    compressed_bytes += level.size();
+  }
+  // An uncompressed RGBA8 mip chain is a third larger than its base level
+  auto uncompressed_bytes = image.pixels.size() * 4 / 3;
+  QTextStream(stdout) << input << " -> " << output << ": "
+                      << compressed.width << "x" << compressed.height << ", "
+                      << compressed.levels.size() << " levels, "
+                      << compressed_bytes << " bytes ("
+                      << QString::number(double(uncompressed_bytes) /
+                                             compressed_bytes,
+                                         'f', 1)
+                      << "x smaller)\n";
+  return 0;
+}
+
+// Best parse throughput out of a few loads of the given model
+double parse_throughput(const QString& input, const ModelOptions& options) {
+  double best = 0.0;
+  for (int i = 0; i < bench_repetitions; ++i) {
+    Model model(input, options);
+    best = std::max(best, model.getParseStats().megabytesPerSecond());
+  }
+  return best;
+}
+
+// Compares the parse throughput of the QTextStream parser with the mapped
+// parser running on an increasing number of threads
+int bench_obj(const QStringList& args) {
+  if (args.isEmpty()) {
+    print_usage();
+    return 1;
+  }
+
+  auto previous_handler = qInstallMessageHandler(silent_message_handler);
+  QTextStream out(stdout);
+  for (const auto& input : args) {
+    out << input << "\n";
+
+    ModelOptions options;
+    options.parser = ModelOptions::Parser::TextStream;
+    out << QString("  QTextStream:         %1 MB/s\n")
+               .arg(parse_throughput(input, options), 0, 'f', 1);
+
+    options.parser = ModelOptions::Parser::Mapped;
+    double single_thread = 0.0;
+    for (int threads : {1, 2, 4, 8}) {
+      options.threads = threads;
+      auto throughput = parse_throughput(input, options);
+      if (threads == 1) {
+        single_thread = throughput;
+      }
+      out << QString("  mapped, %1 thread(s): %2 MB/s (%3x)\n")
+                 .arg(threads)
+                 .arg(throughput, 0, 'f', 1)
+                 .arg(throughput / single_thread, 0, 'f', 2);
+    }
+    out.flush();
+  }
+  qInstallMessageHandler(previous_handler);
+  return 0;
+}
+
+// Reports how much the resident set grows at its peak while loading each
+// model into a MeshData, i.e. the transient memory the loader needs
+int bench_load(const QStringList& args) {
+  if (args.isEmpty()) {
+    print_usage();
+    return 1;
+  }
+
+  auto previous_handler = qInstallMessageHandler(silent_message_handler);
+  QTextStream out(stdout);
+  constexpr double megabyte = 1024.0 * 1024.0;
+  for (const auto& input : args) {
+    bool peak_reset = reset_peak_resident_bytes();
+    auto before = current_resident_bytes();
+    auto mesh = load_obj(input);
+    auto peak = peak_resident_bytes();
+    auto mesh_bytes = mesh.vertices.size() * sizeof(Vertex) +
+                      mesh.indices.size() * sizeof(unsigned int);
+
+    out << input << "\n";
+    out << QString("  mesh data:       %1 MB\n").arg(mesh_bytes / megabyte, 0,
+                                                    'f', 2);
+    if (!peak_reset || before < 0 || peak < 0) {
+      out << "  peak RSS:        not available on this platform\n";
+      continue;
+    }
+    out << QString("  peak RSS growth: %1 MB (%2x the mesh data)\n")
+               .arg((peak - before) / megabyte, 0, 'f', 2)
+               .arg((peak - before) / double(std::max<size_t>(mesh_bytes, 1)),
+                    0, 'f', 1);
+    out.flush();
+  }
+  qInstallMessageHandler(previous_handler);
+  return 0;
+}
+
+// Best conversion rate out of a few runs of convert on the given image, in
+// megapixels per second
+template <typename Convert>
+double conversion_rate(const QImage& image, Convert convert) {
+  double best = 0.0;
+  auto megapixels = double(image.width()) * image.height() / 1.0e6;
+  for (int i = 0; i < bench_repetitions; ++i) {
+    QElapsedTimer timer;
+    timer.start();
+    auto pixels = convert(image);
+    auto elapsed_ns = std::max<qint64>(timer.nsecsElapsed(), 1);
+    best = std::max(best, megapixels / (elapsed_ns / 1.0e9));
+  }
+  return best;
+}
+
+// Compares the per-pixel image conversion with the scanline one
+int bench_image(const QStringList& args) {
+  if (args.isEmpty()) {
+    print_usage();
+    return 1;
+  }
+
+  QTextStream out(stdout);
+  for (const auto& input : args) {
+    QImage image(input);
+    if (image.isNull()) {
+      QTextStream(stderr) << "Failed to load " << input << "\n";
+      return 1;
+    }
+    out << input << " (" << image.width() << "x" << image.height()
+        << ", format " << image.format() << ")\n";
+
+    auto per_pixel = conversion_rate(image, image_to_bytes_per_pixel);
+    auto scanline = conversion_rate(image, image_to_rgba);
+    out << QString("  QImage::pixel: %1 MP/s\n").arg(per_pixel, 0, 'f', 1);
+    out << QString("  scanlines:     %1 MP/s (%2x)\n")
+               .arg(scanline, 0, 'f', 1)
+               .arg(scanline / per_pixel, 0, 'f', 1);
+    if (image_to_rgba(image) != image_to_bytes_per_pixel(image)) {
+      out << "  warning: conversions differ\n";
+    }
+    out.flush();
+  }
+  return 0;
+}
+} // namespace
+
+int main(int argc, char* argv[]) {
+  QCoreApplication app(argc, argv);
+
+  auto args = app.arguments();
+  if (args.size() < 2) {
+    print_usage();
+    return 1;
+  }
+
+  auto command = args[1];
+  args = args.mid(2);
+  if (command == "mesh") {
+    return compile_mesh(args);
+  }
+  if (command == "texture") {
+    return compile_texture(args);
+  }
+  if (command == "bench-obj") {
+    return bench_obj(args);
+  }
+  if (command == "bench-load") {
+    return bench_load(args);
+  }
+  if (command == "bench-image") {
+    return bench_image(args);
+  }
+
+  print_usage();
+  return 1;
+}
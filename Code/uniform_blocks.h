@@ -0,0 +1,78 @@
+#ifndef UNIFORM_BLOCKS_H
+#define UNIFORM_BLOCKS_H
+
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <cstddef>
+#include <cstdint>
+
+// Uniform blocks shared by the scene shaders, laid out as std140 lays out
+// the blocks of the same names in the shaders. Matrices are column major,
+// vec3s are aligned to 16 bytes and array elements take 16 bytes each.
+
+// Binding points of the blocks
+enum UniformBinding : GLuint {
+  pass_binding = 0,
+  material_binding,
+  draw_binding,
+  shadow_binding,
+};
+
+struct Std140Float {
+  float value;
+  float padding[3];
+};
+
+// Set once per pass
+struct PassBlock {
+  float view[16];
+  float projection[16];
+  float light_position[3];
+  float padding;
+  float light_color[3];
+  float time;
+};
+
+// Set when the material changes
+struct MaterialBlock {
+  // ka, kd, ks and the specular exponent
+  float properties[4];
+  float diffuse_layer;
+  float wave_mask_layer;
+  std::int32_t is_water;
+  float padding;
+  Std140Float amplitude[6];
+  Std140Float frequency[6];
+  Std140Float phase[6];
+};
+
+// Set for every mesh, the instances of which have their own attributes
+struct DrawBlock {
+  float position_offset[3];
+  float padding;
+  float position_scale[3];
+  std::int32_t octahedral_normals;
+};
+
+// Shadow map cascades, set once per frame
+struct ShadowBlock {
+  float light_space[4][16];
+  Std140Float cascade_far[4];
+  Std140Float cascade_scale[4];
+  // Depth bias of each cascade relative to that of the nearest one
+  Std140Float cascade_bias_scale[4];
+  std::int32_t cascade_count;
+  float padding[3];
+};
+
+static_assert(offsetof(PassBlock, time) == 156, "PassBlock must be std140");
+static_assert(offsetof(MaterialBlock, amplitude) == 32 &&
+                  sizeof(MaterialBlock) == 320,
+              "MaterialBlock must be std140");
+static_assert(offsetof(DrawBlock, position_scale) == 16 &&
+                  offsetof(DrawBlock, octahedral_normals) == 28,
+              "DrawBlock must be std140");
+static_assert(offsetof(ShadowBlock, cascade_count) == 448,
+              "ShadowBlock must be std140");
+
+#endif // UNIFORM_BLOCKS_H
@@ -0,0 +1,112 @@
+#include <QDebug>
+
+#include <algorithm>
+
+#include "uniform_ring.h"
+
+UniformRing::UniformRing(std::size_t frame_size, int frames)
+    : segment_size(frame_size), fences(std::max(frames, 1), nullptr) {
+  initializeOpenGLFunctions();
+
+  GLint offset_alignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offset_alignment);
+  alignment = std::max<std::size_t>(offset_alignment, 16);
+  segment_size = aligned(segment_size);
+
+  glGenBuffers(1, &buffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+  glBufferData(GL_UNIFORM_BUFFER, segment_size * fences.size(), nullptr,
+               GL_STREAM_DRAW);
+}
+
+UniformRing::~UniformRing() {
+  for (auto fence : fences) {
+    if (fence) {
+      glDeleteSync(fence);
+    }
+  }
+  glDeleteBuffers(1, &buffer);
+}
+
+void UniformRing::begin_frame() {
+  if (overflow > 0) {
+    grow();
+  }
+  segment = (segment + 1) % fences.size();
+  head = segment * segment_size;
+
+  auto& fence = fences[segment];
+  if (fence) {
+    // Frames in flight are bounded by the segments, only waits when the GPU
+    // is that many frames behind
+    while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) ==
+           GL_TIMEOUT_EXPIRED) {
+    }
+    glDeleteSync(fence);
+    fence = nullptr;
+  }
+}
+
+void UniformRing::end_frame() {
+  auto& fence = fences[segment];
+  if (fence) {
+    glDeleteSync(fence);
+  }
+  fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+std::size_t UniformRing::aligned(std::size_t size) const {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+UniformRing::Mapping UniformRing::map(std::size_t size) {
+  size = aligned(size);
+  if (head + size > (segment + 1) * segment_size) {
+    overflow += size;
+    return {};
+  }
+
+  // The segment's fence has signalled, nothing reads it
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+  auto data = static_cast<std::uint8_t*>(glMapBufferRange(
+      GL_UNIFORM_BUFFER, head, size,
+      GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT |
+          GL_MAP_UNSYNCHRONIZED_BIT));
+  if (!data) {
+    qDebug() << "Failed to map the uniform ring";
+    return {};
+  }
+
+  Mapping mapping;
+  mapping.data = data;
+  mapping.offset = head;
+  head += size;
+  return mapping;
+}
+
+void UniformRing::unmap() {
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+  glUnmapBuffer(GL_UNIFORM_BUFFER);
+}
+
+void UniformRing::bind(GLuint binding, std::size_t offset, std::size_t size) {
+  glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, size);
+}
+
+void UniformRing::grow() {
+  segment_size = std::max(segment_size * 2, aligned(segment_size + overflow));
+  overflow = 0;
+  qDebug() << ":: Growing the uniform ring to" << segment_size
+           << "bytes per frame";
+
+  // The new storage is unused, the old fences no longer matter
+  for (auto& fence : fences) {
+    if (fence) {
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+  }
+  glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+  glBufferData(GL_UNIFORM_BUFFER, segment_size * fences.size(), nullptr,
+               GL_STREAM_DRAW);
+}
@@ -0,0 +1,60 @@
+#ifndef UNIFORM_RING_H
+#define UNIFORM_RING_H
+
+#include <QOpenGLFunctions_3_3_Core>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A uniform buffer that blocks are sub-allocated from every frame and bound
+// by range. The buffer is split into one segment per frame in flight, and a
+// segment is only written again once the GPU has signalled it finished the
+// frame that last used it, so writes never wait on draws still reading.
+class UniformRing : protected QOpenGLFunctions_3_3_Core {
+public:
+  struct Mapping {
+    std::uint8_t* data = nullptr;
+    // Of the mapped range in the buffer
+    std::size_t offset = 0;
+  };
+
+  explicit UniformRing(std::size_t frame_size, int frames = 3);
+  ~UniformRing();
+
+  UniformRing(const UniformRing&) = delete;
+  UniformRing& operator=(const UniformRing&) = delete;
+
+  // Moves on to the next segment, waiting for the GPU to finish the frame
+  // that used it before if it has not yet
+  void begin_frame();
+  // Fences the frame's segment, call after the frame's last draw
+  void end_frame();
+
+  // Size of a block rounded up to the alignment of bound ranges
+  std::size_t aligned(std::size_t size) const;
+  // Maps room for the next blocks of the frame, unmap before drawing. Maps
+  // nothing when the frame's segment is full, the next frame has more room.
+  Mapping map(std::size_t size);
+  void unmap();
+  void bind(GLuint binding, std::size_t offset, std::size_t size);
+  // Mapped ranges may hold other data than blocks, such as instance
+  // attributes read from the buffer as a vertex buffer
+  GLuint gl_handle() const { return buffer; }
+
+private:
+  // Respecifies the buffer with a larger segment size. Only between frames,
+  // as ranges bound during a frame would then read the new storage.
+  void grow();
+
+  GLuint buffer = 0;
+  std::size_t alignment = 256;
+  std::size_t segment_size;
+  std::vector<GLsync> fences;
+  int segment = 0;
+  std::size_t head = 0;
+  // Bytes the frame needed beyond its segment
+  std::size_t overflow = 0;
+};
+
+#endif // UNIFORM_RING_H
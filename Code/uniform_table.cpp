@@ -0,0 +1,83 @@
+#include <QDebug>
+
+#include <cstring>
+
+#include "uniform_table.h"
+
+void UniformTable::reflect(GLuint linked_program) {
+  initializeOpenGLFunctions();
+  program = linked_program;
+  indices.clear();
+  entries.clear();
+
+  GLint count = 0, max_length = 0;
+  glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+  glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &max_length);
+  QByteArray name(max_length, '\0');
+  for (GLint i = 0; i < count; ++i) {
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+    glGetActiveUniform(program, i, max_length, &length, &size, &type,
+                       name.data());
+    auto key = name.left(length);
+    // Members of uniform blocks have no location
+    auto location = glGetUniformLocation(program, key.constData());
+    if (location == -1) {
+      continue;
+    }
+    // Arrays are named after their first element
+    if (key.endsWith("[0]")) {
+      key.chop(3);
+    }
+
+    Entry entry;
+    entry.location = location;
+    entry.type = type;
+    indices.insert(key, entries.size());
+    entries.push_back(entry);
+  }
+}
+
+UniformStats UniformTable::take_stats() {
+  auto taken = stats;
+  stats = UniformStats();
+  return taken;
+}
+
+int UniformTable::find(const char* name, bool (*matches)(GLenum)) const {
+  auto index = indices.value(QByteArray(name), -1);
+  if (index == -1) {
+    return -1;
+  }
+  if (!matches(entries[index].type)) {
+    qDebug() << "Uniform" << name << "is of another type";
+    return -1;
+  }
+  return index;
+}
+
+bool UniformTable::update(Entry& entry, const void* value, std::size_t size) {
+  if (entry.has_value && std::memcmp(entry.value, value, size) == 0) {
+    return false;
+  }
+  std::memcpy(entry.value, value, size);
+  entry.has_value = true;
+  return true;
+}
+
+void UniformTable::upload(GLint location, const int& value) {
+  glUniform1i(location, value);
+}
+
+void UniformTable::upload(GLint location, const float& value) {
+  glUniform1f(location, value);
+}
+
+void UniformTable::upload(GLint location, const QVector3D& value) {
+  glUniform3f(location, value.x(), value.y(), value.z());
+}
+
+void UniformTable::upload(GLint location, const QMatrix4x4& value) {
+  glUniformMatrix4fv(location, 1, GL_FALSE, value.constData());
+}
@@ -0,0 +1,148 @@
+#ifndef UNIFORM_TABLE_H
+#define UNIFORM_TABLE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMatrix4x4>
+#include <QOpenGLFunctions_3_3_Core>
+#include <QVector3D>
+
+#include <cstddef>
+#include <vector>
+
+#include "gl_state.h"
+
+// glUniform calls of a program, and calls skipped as the uniform already had
+// the value
+struct UniformStats {
+  int calls = 0;
+  int calls_avoided = 0;
+};
+
+// GL types of the uniforms values of a C++ type can be set to. Types without
+// a specialisation cannot be used for uniforms.
+template <typename T> struct UniformType;
+
+template <> struct UniformType<int> {
+  // Samplers and booleans are set as integers
+  static bool matches(GLenum type) {
+    switch (type) {
+    case GL_INT:
+    case GL_BOOL:
+    case GL_SAMPLER_2D:
+    case GL_SAMPLER_2D_SHADOW:
+    case GL_SAMPLER_2D_ARRAY:
+    case GL_SAMPLER_2D_ARRAY_SHADOW:
+    case GL_SAMPLER_CUBE:
+      return true;
+    default:
+      return false;
+    }
+  }
+};
+
+template <> struct UniformType<float> {
+  static bool matches(GLenum type) { return type == GL_FLOAT; }
+};
+
+template <> struct UniformType<QVector3D> {
+  static bool matches(GLenum type) { return type == GL_FLOAT_VEC3; }
+};
+
+template <> struct UniformType<QMatrix4x4> {
+  static bool matches(GLenum type) { return type == GL_FLOAT_MAT4; }
+};
+
+// A uniform of a program, resolved once and checked against the type it was
+// declared with. Default constructed handles refer to no uniform, setting
+// them does nothing.
+template <typename T> class Uniform {
+public:
+  Uniform() = default;
+
+  bool is_valid() const { return index >= 0; }
+
+private:
+  friend class UniformTable;
+  explicit Uniform(int index) : index(index) {}
+
+  int index = -1;
+};
+
+// The active uniforms of a linked program outside of uniform blocks, by name.
+// Keeps the last value set for each, so that setting a uniform to the value it
+// already has costs no GL call.
+class UniformTable : protected QOpenGLFunctions_3_3_Core {
+public:
+  // Enumerates the uniforms of a program, which must have been linked
+  void reflect(GLuint program);
+
+  // Looks up a uniform by name, arrays by their name without an index. Gives
+  // an invalid handle when the program has no such uniform, or it was
+  // declared with a type T cannot set, which is also logged.
+  template <typename T> Uniform<T> find(const char* name) const;
+
+  // Sets a uniform unless it already has the value, binding the program when
+  // it does not
+  template <typename T> void set(Uniform<T> uniform, const T& value);
+
+  // Calls since the last call
+  UniformStats take_stats();
+
+private:
+  struct Entry {
+    GLint location;
+    GLenum type;
+    // Raw value last set, as at most a 4x4 matrix of floats
+    bool has_value = false;
+    GLfloat value[16];
+  };
+
+  // Index of the uniform's entry, -1 when there is none of the type
+  int find(const char* name, bool (*matches)(GLenum)) const;
+  // Whether the entry's value differs, storing the new value when it does
+  bool update(Entry& entry, const void* value, std::size_t size);
+
+  static const void* data(const int& value) { return &value; }
+  static const void* data(const float& value) { return &value; }
+  static const void* data(const QVector3D& value) { return &value; }
+  static const void* data(const QMatrix4x4& value) {
+    return value.constData();
+  }
+  static std::size_t size(const int&) { return sizeof(GLint); }
+  static std::size_t size(const float&) { return sizeof(GLfloat); }
+  static std::size_t size(const QVector3D&) { return 3 * sizeof(GLfloat); }
+  static std::size_t size(const QMatrix4x4&) { return 16 * sizeof(GLfloat); }
+
+  void upload(GLint location, const int& value);
+  void upload(GLint location, const float& value);
+  void upload(GLint location, const QVector3D& value);
+  void upload(GLint location, const QMatrix4x4& value);
+
+  GLuint program = 0;
+  QHash<QByteArray, int> indices;
+  std::vector<Entry> entries;
+  UniformStats stats;
+};
+
+template <typename T>
+Uniform<T> UniformTable::find(const char* name) const {
+  return Uniform<T>(find(name, &UniformType<T>::matches));
+}
+
+template <typename T>
+void UniformTable::set(Uniform<T> uniform, const T& value) {
+  if (!uniform.is_valid()) {
+    return;
+  }
+  auto& entry = entries[uniform.index];
+  if (!update(entry, data(value), size(value))) {
+    ++stats.calls_avoided;
+    return;
+  }
+  GLState::current().use_program(program);
+  upload(entry.location, value);
+  ++stats.calls;
+}
+
+#endif // UNIFORM_TABLE_H
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+#include "vertex_format.h"
+
+namespace {
+std::int16_t to_snorm16(float value) {
+  value = std::max(-1.0f, std::min(1.0f, value));
+  return static_cast<std::int16_t>(std::lround(value * 32767.0f));
+}
+
+std::uint32_t to_snorm10(float value) {
+  value = std::max(-1.0f, std::min(1.0f, value));
+  return static_cast<std::uint32_t>(std::lround(value * 511.0f)) & 0x3ff;
+}
+
+std::uint32_t pack_2_10_10_10(const Vector& normal) {
+  return to_snorm10(normal.x) | (to_snorm10(normal.y) << 10) |
+         (to_snorm10(normal.z) << 20);
+}
+
+float sign_not_zero(float value) { return value >= 0.0f ? 1.0f : -1.0f; }
+
+// Projects the normal onto an octahedron, unfolded into the [-1, 1] square
+std::uint32_t pack_octahedral(const Vector& normal) {
+  float l1 = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+  float u = 0.0f, v = 0.0f;
+  if (l1 > 0.0f) {
+    u = normal.x / l1;
+    v = normal.y / l1;
+    if (normal.z < 0.0f) {
+      float folded_u = (1.0f - std::abs(v)) * sign_not_zero(u);
+      float folded_v = (1.0f - std::abs(u)) * sign_not_zero(v);
+      u = folded_u;
+      v = folded_v;
+    }
+  }
+  return static_cast<std::uint16_t>(to_snorm16(u)) |
+         (static_cast<std::uint32_t>(static_cast<std::uint16_t>(to_snorm16(v)))
+          << 16);
+}
+} // namespace
+
+std::uint16_t float_to_half(float value) {
+  std::uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+
+  std::uint32_t sign = (bits >> 16) & 0x8000;
+  std::uint32_t float_exponent = (bits >> 23) & 0xff;
+  std::uint32_t mantissa = bits & 0x7fffff;
+
+  if (float_exponent == 0xff) {
+    // Infinity or NaN
+    return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+  }
+
+  int exponent = static_cast<int>(float_exponent) - 127 + 15;
+  if (exponent >= 31) {
+    return sign | 0x7c00;
+  }
+  if (exponent <= 0) {
+    // Subnormal half, or too small and flushed to zero
+    if (exponent < -10) {
+      return sign;
+    }
+    mantissa |= 0x800000;
+    int shift = 14 - exponent;
+    std::uint32_t half = mantissa >> shift;
+    std::uint32_t remainder = mantissa & ((1u << shift) - 1);
+    std::uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (half & 1))) {
+      ++half;
+    }
+    return sign | half;
+  }
+
+  // Round to nearest even, a carry into the exponent is still correct
+  std::uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+  std::uint32_t remainder = mantissa & 0x1fff;
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+    ++half;
+  }
+  return half;
+}
+
+std::vector<PackedVertex> pack_vertices(const Vertex* vertices,
+                                        std::size_t count, VertexFormat format,
+                                        PositionDecode& decode) {
+  constexpr auto inf = std::numeric_limits<float>::infinity();
+  Vector min(inf, inf, inf), max(-inf, -inf, -inf);
+  for (std::size_t i = 0; i < count; ++i) {
+    const auto& pos = vertices[i].pos;
+    min = Vector(std::min(min.x, pos.x), std::min(min.y, pos.y),
+                 std::min(min.z, pos.z));
+    max = Vector(std::max(max.x, pos.x), std::max(max.y, pos.y),
+                 std::max(max.z, pos.z));
+  }
+
+  // Map the bounds onto [-1, 1] on every axis
+  auto half_extent = [](float lo, float hi) {
+    return hi > lo ? (hi - lo) / 2.0f : 1.0f;
+  };
+  decode.offset = count > 0 ? Vector((min.x + max.x) / 2.0f,
+                                     (min.y + max.y) / 2.0f,
+                                     (min.z + max.z) / 2.0f)
+                            : Vector(0.0f, 0.0f, 0.0f);
+  decode.scale = count > 0 ? Vector(half_extent(min.x, max.x),
+                                    half_extent(min.y, max.y),
+                                    half_extent(min.z, max.z))
+                           : Vector(1.0f, 1.0f, 1.0f);
+
+  std::vector<PackedVertex> packed(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    const auto& vertex = vertices[i];
+    auto& out = packed[i];
+    out.pos[0] = to_snorm16((vertex.pos.x - decode.offset.x) / decode.scale.x);
+    out.pos[1] = to_snorm16((vertex.pos.y - decode.offset.y) / decode.scale.y);
+    out.pos[2] = to_snorm16((vertex.pos.z - decode.offset.z) / decode.scale.z);
+    out.pos[3] = 0;
+    out.normal = format == VertexFormat::Octahedral
+                     ? pack_octahedral(vertex.normal)
+                     : pack_2_10_10_10(vertex.normal);
+    out.coords[0] = float_to_half(vertex.coords.u);
+    out.coords[1] = float_to_half(vertex.coords.v);
+  }
+  return packed;
+}
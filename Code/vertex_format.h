@@ -0,0 +1,42 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "vertex.h"
+
+// Layout of the vertices in a Mesh's vertex buffer
+enum class VertexFormat {
+  // Vertex as is, 32 bytes
+  Float,
+  // PackedVertex with GL_INT_2_10_10_10_REV normals, 16 bytes
+  Packed,
+  // PackedVertex with octahedral-encoded 16-bit normals, 16 bytes
+  Octahedral,
+};
+
+// Quantized vertex. Positions are 16-bit normalized values relative to the
+// mesh bounds, texture coordinates are half floats.
+struct PackedVertex {
+  std::int16_t pos[4];
+  std::uint32_t normal;
+  std::uint16_t coords[2];
+};
+
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex must be tightly packed");
+
+// Positions are decoded as offset + quantized * scale
+struct PositionDecode {
+  Vector offset{0.0f, 0.0f, 0.0f};
+  Vector scale{1.0f, 1.0f, 1.0f};
+};
+
+std::vector<PackedVertex> pack_vertices(const Vertex* vertices,
+                                        std::size_t count, VertexFormat format,
+                                        PositionDecode& decode);
+
+std::uint16_t float_to_half(float value);
+
+#endif // VERTEX_FORMAT_H